@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+#define ARCHIVE_IDX_MAGIC 0x49414e4c	/* "LNAI" */
+#define ARCHIVE_RUN_MAGIC 0x52414e4c	/* "LNAR" */
+
+/* precedes each run's records in .dat, so the index can be rebuilt */
+struct archive_run {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t rec_nbytes;
+	uint32_t run;
+	uint32_t nrecs;
+	uint64_t time;
+	uint64_t rsvd;
+};
+
+static void archive_path(char *path, const char *dir, const char *devid, const char *ext)
+{
+	snprintf(path, PATH_MAX, "%s/%s.%s", dir, devid, ext);
+}
+
+static int read_full(int fd, void *buf, size_t nbytes, off_t off)
+{
+	ssize_t r = pread(fd, buf, nbytes, off);
+
+	if (r < 0)
+		return -errno;
+	return (size_t)r == nbytes ? 0 : -EIO;
+}
+
+static int write_full(int fd, const void *buf, size_t nbytes, off_t off)
+{
+	const char *p = buf;
+
+	while (nbytes) {
+		ssize_t r = pwrite(fd, p, nbytes, off);
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += r;
+		off += r;
+		nbytes -= r;
+	}
+
+	return 0;
+}
+
+/* first line of a sysfs attribute, or 0 if it is missing or empty */
+static int archive_sysfs_read(const char *base, const char *attr, char *buf, size_t len)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+	size_t n;
+
+	snprintf(path, sizeof(path), "/sys/class/block/%s/%s", base, attr);
+	fp = fopen(path, "r");
+	if (!fp)
+		return 0;
+	if (!fgets(buf, len, fp))
+		buf[0] = '\0';
+	fclose(fp);
+
+	n = strcspn(buf, "\n");
+	while (n && buf[n - 1] == ' ')
+		n--;
+	buf[n] = '\0';
+
+	return n > 0;
+}
+
+const char *archive_devid(char *devid, const char *devname, uint32_t nchannels, uint32_t nluns,
+			  uint32_t nblocks, uint32_t npages, uint32_t nsectors, uint32_t sector_nbytes)
+{
+	static const char *attrs[] = { "device/serial", "wwid", "device/wwid" };
+	uint32_t geo[] = { nchannels, nluns, nblocks, npages, nsectors, sector_nbytes };
+	const unsigned char *p = (const unsigned char *)geo;
+	const char *base = strrchr(devname, '/');
+	const char *source = NULL;
+	char id[256];
+	uint32_t h = 2166136261u;
+
+	base = base ? base + 1 : devname;
+	for (size_t i = 0; i < sizeof(attrs) / sizeof(attrs[0]) && !source; i++)
+		if (archive_sysfs_read(base, attrs[i], id, sizeof(id)))
+			source = attrs[i];
+
+	/* a long id is truncated, so all of it goes into the hash */
+	if (source) {
+		for (char *c = id; *c; c++) {
+			h = (h ^ (unsigned char)*c) * 16777619u;
+			if (*c == '/' || *c == ' ')
+				*c = '_';
+		}
+	} else {
+		snprintf(id, sizeof(id), "%s", base);
+		source = "name and geometry";
+	}
+	for (size_t i = 0; i < sizeof(geo); i++)
+		h = (h ^ p[i]) * 16777619u;
+
+	snprintf(devid, ARCHIVE_DEVID_LEN, "%.48s-%08x", id, h);
+
+	return source;
+}
+
+static int archive_hdr_check(const struct archive_hdr *hdr, const char *devid)
+{
+	if (hdr->magic != ARCHIVE_IDX_MAGIC || hdr->version != ARCHIVE_VERSION ||
+	    hdr->rec_nbytes != sizeof(struct archive_rec) ||
+	    hdr->idx_nbytes != sizeof(struct archive_idx))
+		return -EINVAL;
+	if (strncmp(hdr->devid, devid, ARCHIVE_DEVID_LEN))
+		return -EINVAL;
+
+	return 0;
+}
+
+int archive_append(const char *dir, const char *devid, uint32_t nchannels, uint32_t nluns,
+		   uint32_t nblocks, uint32_t npages, const struct archive_rec *recs, uint32_t nrecs)
+{
+	char path[PATH_MAX];
+	struct archive_hdr hdr;
+	struct archive_run run;
+	struct archive_idx idx, last;
+	struct stat st;
+	uint32_t nruns;
+	int ifd, dfd = -1;
+	int ret;
+
+	if (mkdir(dir, 0755) && errno != EEXIST)
+		return -errno;
+
+	archive_path(path, dir, devid, "idx");
+	ifd = open(path, O_RDWR | O_CREAT, 0644);
+	if (ifd < 0)
+		return -errno;
+	if (flock(ifd, LOCK_EX) || fstat(ifd, &st)) {
+		ret = -errno;
+		goto out;
+	}
+
+	if (st.st_size < (off_t)sizeof(hdr)) {
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic = ARCHIVE_IDX_MAGIC;
+		hdr.version = ARCHIVE_VERSION;
+		hdr.rec_nbytes = sizeof(struct archive_rec);
+		hdr.idx_nbytes = sizeof(struct archive_idx);
+		hdr.nchannels = nchannels;
+		hdr.nluns = nluns;
+		hdr.nblocks = nblocks;
+		hdr.npages = npages;
+		strncpy(hdr.devid, devid, ARCHIVE_DEVID_LEN - 1);
+		ret = write_full(ifd, &hdr, sizeof(hdr), 0);
+		if (ret)
+			goto out;
+		st.st_size = sizeof(hdr);
+	} else {
+		ret = read_full(ifd, &hdr, sizeof(hdr), 0);
+		if (!ret)
+			ret = archive_hdr_check(&hdr, devid);
+		if (ret)
+			goto out;
+	}
+
+	/* a torn trailing entry is ignored and overwritten */
+	nruns = (st.st_size - sizeof(hdr)) / sizeof(struct archive_idx);
+	memset(&last, 0, sizeof(last));
+	if (nruns) {
+		ret = read_full(ifd, &last, sizeof(last), sizeof(hdr) + (nruns - 1) * sizeof(last));
+		if (ret)
+			goto out;
+	}
+
+	archive_path(path, dir, devid, "dat");
+	dfd = open(path, O_WRONLY | O_CREAT, 0644);
+	if (dfd < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.magic = ARCHIVE_RUN_MAGIC;
+	run.version = ARCHIVE_VERSION;
+	run.rec_nbytes = sizeof(struct archive_rec);
+	run.run = nruns ? last.run + 1 : 0;
+	run.nrecs = nrecs;
+	run.time = time(NULL);
+	if (run.time < last.time)
+		run.time = last.time;
+
+	/* records of a run whose index entry never made it are dead space */
+	idx.off = lseek(dfd, 0, SEEK_END);
+	ret = write_full(dfd, &run, sizeof(run), idx.off);
+	if (ret)
+		goto out;
+	idx.off += sizeof(run);
+	ret = write_full(dfd, recs, nrecs * sizeof(*recs), idx.off);
+	if (!ret && fsync(dfd))
+		ret = -errno;
+	if (ret)
+		goto out;
+
+	idx.time = run.time;
+	idx.run = run.run;
+	idx.nrecs = nrecs;
+	idx.key_min = nrecs ? recs[0].key : 0;
+	idx.key_max = nrecs ? recs[nrecs - 1].key : 0;
+	ret = write_full(ifd, &idx, sizeof(idx), sizeof(hdr) + nruns * sizeof(idx));
+	if (!ret && fsync(ifd))
+		ret = -errno;
+out:
+	if (dfd >= 0)
+		close(dfd);
+	close(ifd);
+	return ret;
+}
+
+struct archive *archive_open(const char *dir, const char *devid)
+{
+	char path[PATH_MAX];
+	struct archive *ar;
+	struct stat st;
+	int ifd;
+
+	ar = calloc(1, sizeof(*ar));
+	if (!ar)
+		return NULL;
+	ar->dat_fd = -1;
+
+	archive_path(path, dir, devid, "idx");
+	ifd = open(path, O_RDONLY);
+	if (ifd < 0)
+		goto err;
+
+	if (fstat(ifd, &st) || read_full(ifd, &ar->hdr, sizeof(ar->hdr), 0) ||
+	    archive_hdr_check(&ar->hdr, devid)) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	ar->nruns = (st.st_size - sizeof(ar->hdr)) / sizeof(struct archive_idx);
+	ar->runs = malloc(ar->nruns * sizeof(struct archive_idx) + 1);
+	if (!ar->runs || read_full(ifd, ar->runs, ar->nruns * sizeof(struct archive_idx), sizeof(ar->hdr)))
+		goto err;
+	close(ifd);
+	ifd = -1;
+
+	archive_path(path, dir, devid, "dat");
+	ar->dat_fd = open(path, O_RDONLY);
+	if (ar->dat_fd < 0)
+		goto err;
+
+	return ar;
+err:
+	if (ifd >= 0)
+		close(ifd);
+	archive_close(ar);
+	return NULL;
+}
+
+void archive_close(struct archive *ar)
+{
+	if (!ar)
+		return;
+
+	if (ar->dat_fd >= 0)
+		close(ar->dat_fd);
+	free(ar->runs);
+	free(ar);
+}
+
+static uint32_t idx_lower_bound(const struct archive *ar, uint64_t time)
+{
+	uint32_t lo = 0, hi = ar->nruns;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (ar->runs[mid].time < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+void archive_range(const struct archive *ar, uint64_t since, uint64_t until, uint32_t *first, uint32_t *last)
+{
+	*first = idx_lower_bound(ar, since);
+	*last = until == UINT64_MAX ? ar->nruns : idx_lower_bound(ar, until + 1);
+	if (*last < *first)
+		*last = *first;
+}
+
+/* first record of run with key >= key, by binary search over the file */
+static int rec_lower_bound(const struct archive *ar, const struct archive_idx *idx, uint32_t key, uint32_t *pos)
+{
+	uint32_t lo = 0, hi = idx->nrecs;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		uint32_t k;
+		int ret;
+
+		ret = read_full(ar->dat_fd, &k, sizeof(k), idx->off + (off_t)mid * sizeof(struct archive_rec));
+		if (ret)
+			return ret;
+		if (k < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*pos = lo;
+	return 0;
+}
+
+int archive_lookup(const struct archive *ar, uint32_t run, uint32_t key_lo, uint32_t key_hi,
+		   struct archive_rec *recs, int max)
+{
+	const struct archive_idx *idx = &ar->runs[run];
+	uint32_t first, end;
+	int ret;
+
+	if (!idx->nrecs || key_hi < idx->key_min || key_lo > idx->key_max)
+		return 0;
+
+	ret = rec_lower_bound(ar, idx, key_lo, &first);
+	if (!ret)
+		ret = key_hi == UINT32_MAX ? (end = idx->nrecs, 0) : rec_lower_bound(ar, idx, key_hi + 1, &end);
+	if (ret)
+		return ret;
+
+	if (end - first > (uint32_t)max)
+		end = first + max;
+	if (end == first)
+		return 0;
+
+	ret = read_full(ar->dat_fd, recs, (end - first) * sizeof(*recs),
+			idx->off + (off_t)first * sizeof(struct archive_rec));
+
+	return ret ? ret : (int)(end - first);
+}
+
+int archive_list(const char *dir, FILE *fp)
+{
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return -errno;
+
+	while ((de = readdir(d))) {
+		char devid[ARCHIVE_DEVID_LEN];
+		size_t len = strlen(de->d_name);
+		struct archive *ar;
+
+		if (len < 5 || len - 4 >= ARCHIVE_DEVID_LEN || strcmp(de->d_name + len - 4, ".idx"))
+			continue;
+
+		memcpy(devid, de->d_name, len - 4);
+		devid[len - 4] = '\0';
+		ar = archive_open(dir, devid);
+		if (!ar)
+			continue;
+
+		fprintf(fp, "%-64s runs %05u", devid, ar->nruns);
+		if (ar->nruns)
+			fprintf(fp, " first %lu last %lu", (unsigned long)ar->runs[0].time,
+				(unsigned long)ar->runs[ar->nruns - 1].time);
+		fprintf(fp, "\n");
+		archive_close(ar);
+	}
+
+	closedir(d);
+	return 0;
+}
@@ -0,0 +1,99 @@
+#ifndef ARCHIVE_H_
+#define ARCHIVE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Append-only archive of per-block results, one pair of files per device
+ * in an archive directory:
+ *
+ *   <devid>.dat  run header, then that run's records sorted by key, per run
+ *   <devid>.idx  header, then one archive_idx per run in time order
+ *
+ * Records are fixed size and sorted, so a block or LUN in a run is found by
+ * binary search with a few small reads. Queries read the index, narrow it
+ * by time, then touch only the records they need in each run. The index
+ * entry for a run is written only after its records are on disk.
+ */
+#define ARCHIVE_VERSION		1
+#define ARCHIVE_DEVID_LEN	64
+
+#define ARCHIVE_KEY(ch, lun, blk) ((uint32_t)(ch) << 24 | (uint32_t)(lun) << 16 | (uint32_t)(blk))
+#define ARCHIVE_KEY_CH(key) ((key) >> 24)
+#define ARCHIVE_KEY_LUN(key) (((key) >> 16) & 0xff)
+#define ARCHIVE_KEY_BLK(key) ((key) & 0xffff)
+
+enum {
+	ARCHIVE_ERASE_FAIL	= 1 << 0,
+	ARCHIVE_WRITE_FAIL	= 1 << 1,
+	ARCHIVE_READ_FAIL	= 1 << 2,
+	ARCHIVE_SKIPPED		= 1 << 3,
+	ARCHIVE_MARKED_BAD	= 1 << 4,
+};
+
+struct archive_rec {
+	uint32_t key;
+	uint16_t read_fails;	/* failed pages over all read passes */
+	uint8_t flags;
+	uint8_t rsvd;
+	uint16_t lat_us[3];	/* read, write per page; erase per block */
+	uint16_t rsvd2;
+};
+
+struct archive_idx {
+	uint64_t time;		/* unix seconds, non-decreasing */
+	uint64_t off;		/* first record in .dat */
+	uint32_t run;
+	uint32_t nrecs;
+	uint32_t key_min;
+	uint32_t key_max;
+};
+
+struct archive_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t rec_nbytes;
+	uint16_t idx_nbytes;
+	uint16_t rsvd;
+	uint32_t nchannels;
+	uint32_t nluns;
+	uint32_t nblocks;
+	uint32_t npages;
+	char devid[ARCHIVE_DEVID_LEN];
+	uint8_t rsvd2[32];
+};
+
+struct archive {
+	int dat_fd;
+	struct archive_hdr hdr;
+	struct archive_idx *runs;
+	uint32_t nruns;
+};
+
+/*
+ * Archive key of a device: its serial or WWID from sysfs when present, else
+ * its name, with a hash of geometry. Returns what the key was taken from.
+ */
+const char *archive_devid(char *devid, const char *devname, uint32_t nchannels, uint32_t nluns,
+			  uint32_t nblocks, uint32_t npages, uint32_t nsectors, uint32_t sector_nbytes);
+
+int archive_append(const char *dir, const char *devid, uint32_t nchannels, uint32_t nluns,
+		   uint32_t nblocks, uint32_t npages, const struct archive_rec *recs, uint32_t nrecs);
+
+struct archive *archive_open(const char *dir, const char *devid);
+void archive_close(struct archive *ar);
+
+/* runs whose time is within [since, until], as [*first, *last) */
+void archive_range(const struct archive *ar, uint64_t since, uint64_t until, uint32_t *first, uint32_t *last);
+
+/*
+ * Records of run with key_lo <= key <= key_hi. Returns the number found, up
+ * to max, or -errno.
+ */
+int archive_lookup(const struct archive *ar, uint32_t run, uint32_t key_lo, uint32_t key_hi,
+		   struct archive_rec *recs, int max);
+
+int archive_list(const char *dir, FILE *fp);
+
+#endif
@@ -0,0 +1,667 @@
+/*
+ * lnvm-bench: host-side microbenchmarks for lnvm-tool.
+ *
+ * lnvm.c is compiled in directly against the stubbed liblightnvm in
+ * nvm_stub.c, so every path below runs the real lnvm-tool code with I/O that
+ * completes immediately. What is left is the host cost: PPA list building,
+ * report bookkeeping, BBT scans, statistics and output formatting.
+ *
+ * Anything lnvm-tool prints goes to /dev/null; results are written to the
+ * original stdout as one JSON object per line.
+ */
+#include "../lnvm.c"
+
+#include <time.h>
+
+#include "nvm_stub.h"
+
+struct bench_ctx {
+	struct nvm_dev *dev;
+	struct nvm_dev *bad_dev;	/* every block marked bad in the BBT */
+	const struct nvm_geo *geo;
+	int *report;			/* [nchannels][nluns][nblocks] */
+	char *kept;			/* [nchannels][nluns][nblocks], adapt */
+	struct io_bufs bufs;
+	int hugepages;			/* backing asked for, bufpool.* too */
+	struct bufpool *big;		/* bufpool.copy */
+	struct oob_conf oob;
+	struct io_conf io;
+	struct fail_map fails;
+	struct runmap maps[2];
+
+	int max_ch;
+	int max_lun;
+	int max_blk;
+};
+
+struct bench {
+	const char *name;
+	const char *unit;
+	/* optional, runs once before calibration */
+	void (*setup)(struct bench_ctx *ctx);
+	/* runs once, returns the number of units processed */
+	long (*fn)(struct bench_ctx *ctx);
+	/* device commands and payload bytes per unit, 0 if not applicable */
+	long (*cmds_per_unit)(const struct nvm_geo *geo);
+	long (*bytes_per_unit)(const struct nvm_geo *geo);
+};
+
+struct bench_args {
+	int reps;
+	int min_ms;
+	int max_blk;
+	char *filter;
+	int hugepages;
+	int touch;
+	int generic;
+	struct nvm_geo geo;
+};
+
+static FILE *out;
+
+static const char *layout_name[] = { "generic", "1x4", "2x4", "4x4" };
+
+static double now_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void fec_init(struct bench_ctx *ctx, struct for_each_conf *fec, int op)
+{
+	memset(fec, 0, sizeof(*fec));
+	fec->max_ch = ctx->max_ch;
+	fec->max_lun = ctx->max_lun;
+	fec->max_blk = ctx->max_blk;
+	fec->op = op;
+	fec->flag = ctx->geo->nplanes >> 1;
+	fec->bufs = ctx->bufs;
+	fec->oob = ctx->oob;
+	fec->io = ctx->io;
+	fec->fails = &ctx->fails;
+}
+
+static void report_clear(struct bench_ctx *ctx)
+{
+	const struct nvm_geo *geo = ctx->geo;
+
+	memset(ctx->report, 0, geo->nchannels * geo->nluns * geo->nblocks *
+							sizeof(int));
+}
+
+static long b_rw_blk(struct bench_ctx *ctx, int op, int show_time)
+{
+	for (int blk = 0; blk < ctx->max_blk; blk++)
+		rw_blk(ctx->dev, ctx->geo, op, 0, 0, blk, show_time,
+				io_data(&ctx->bufs, 0), io_meta(&ctx->bufs, 0),
+				ctx->geo->nplanes >> 1, &ctx->oob,
+				&ctx->io, NULL);
+
+	return ctx->max_blk;
+}
+
+static long b_rw_blk_read(struct bench_ctx *ctx)
+{
+	return b_rw_blk(ctx, 0, 0);
+}
+
+static long b_rw_blk_write(struct bench_ctx *ctx)
+{
+	return b_rw_blk(ctx, 1, 0);
+}
+
+static long b_rw_blk_read_timed(struct bench_ctx *ctx)
+{
+	return b_rw_blk(ctx, 0, 1);
+}
+
+/* every 7th command times out once and succeeds on retry */
+static long b_rw_blk_read_retry(struct bench_ctx *ctx)
+{
+	long n;
+
+	nvm_stub_conf.timeout_every = 7;
+	n = b_rw_blk(ctx, 0, 0);
+	nvm_stub_conf.timeout_every = 0;
+
+	return n;
+}
+
+static long b_erase_blk(struct bench_ctx *ctx)
+{
+	for (int blk = 0; blk < ctx->max_blk; blk++)
+		erase_blk(ctx->dev, ctx->geo, 0, 0, blk, 0,
+					ctx->geo->nplanes >> 1, &ctx->io);
+
+	return ctx->max_blk;
+}
+
+static long b_for_each(struct bench_ctx *ctx, struct nvm_dev *dev, int op)
+{
+	struct for_each_conf fec;
+
+	fec_init(ctx, &fec, op);
+	report_clear(ctx);
+	for_each_blk(dev, ctx->geo, &fec, (void *)ctx->report);
+	failmap_reset(&ctx->fails);
+
+	return (long)ctx->max_ch * ctx->max_lun * ctx->max_blk;
+}
+
+/* reads need valid OOB signatures to stay on the good path */
+static void s_for_each_write(struct bench_ctx *ctx)
+{
+	b_for_each(ctx, ctx->dev, 1);
+}
+
+static long b_for_each_read(struct bench_ctx *ctx)
+{
+	return b_for_each(ctx, ctx->dev, 0);
+}
+
+/* progress counters on, no monitor thread */
+static long b_for_each_read_progress(struct bench_ctx *ctx)
+{
+	struct progress *prog = ctx->io.prog;
+	long n;
+
+	if (!prog)
+		ctx->io.prog = progress_create(NULL, ctx->geo->nchannels, ctx->geo->nluns, 0);
+	n = b_for_each(ctx, ctx->dev, 0);
+	if (!prog) {
+		progress_destroy(ctx->io.prog);
+		ctx->io.prog = NULL;
+	}
+
+	return n;
+}
+
+/* per phase laps on, what -C costs */
+static long b_for_each_read_profile(struct bench_ctx *ctx)
+{
+	struct prof *prof = ctx->io.prof;
+	long n;
+
+	if (!prof)
+		ctx->io.prof = prof_create(ctx->geo->nchannels * ctx->geo->nluns);
+	n = b_for_each(ctx, ctx->dev, 0);
+	if (!prof) {
+		prof_destroy(ctx->io.prof);
+		ctx->io.prof = NULL;
+	}
+
+	return n;
+}
+
+static long b_for_each_erase(struct bench_ctx *ctx)
+{
+	return b_for_each(ctx, ctx->dev, 2);
+}
+
+/*
+ * LUN 0 fails every erase; with -F 20 its rest is left untested. The LUN
+ * needs more blocks than the give-up sample for that to happen at all.
+ */
+static long b_for_each_weak_lun(struct bench_ctx *ctx, int adapt)
+{
+	struct for_each_conf fec;
+	struct adapt_lun luns[ctx->geo->nchannels * ctx->geo->nluns];
+	int max_blk = ctx->max_blk > 4 * ADAPT_MIN_SAMPLE ? ctx->max_blk : 4 * ADAPT_MIN_SAMPLE;
+
+	fec_init(ctx, &fec, 2);
+	fec.dry_run = 1;
+	fec.max_blk = max_blk < (int)ctx->geo->nblocks ? max_blk : (int)ctx->geo->nblocks;
+	if (adapt) {
+		memset(luns, 0, sizeof(luns));
+		fec.adapt.lun_fail_pct = 20;
+		fec.adapt.nluns = ctx->geo->nluns;
+		fec.adapt.luns = luns;
+		fec.adapt.kept = ctx->kept;
+		memset(ctx->kept, 1, ctx->geo->nchannels * ctx->geo->nluns * ctx->geo->nblocks);
+	}
+	report_clear(ctx);
+
+	nvm_stub_conf.weak_lun = 1;
+	for_each_blk(ctx->dev, ctx->geo, &fec, (void *)ctx->report);
+	nvm_stub_conf.weak_lun = 0;
+	failmap_reset(&ctx->fails);
+
+	return (long)ctx->max_ch * ctx->max_lun * fec.max_blk;
+}
+
+static long b_for_each_weak_lun_plain(struct bench_ctx *ctx)
+{
+	return b_for_each_weak_lun(ctx, 0);
+}
+
+static long b_for_each_weak_lun_adapt(struct bench_ctx *ctx)
+{
+	return b_for_each_weak_lun(ctx, 1);
+}
+
+static long b_for_each_bbt_skip(struct bench_ctx *ctx)
+{
+	return b_for_each(ctx, ctx->bad_dev, 2);
+}
+
+static long b_for_each_read_fail(struct bench_ctx *ctx)
+{
+	long n;
+
+	nvm_stub_conf.read_fail_every = 7;
+	n = b_for_each(ctx, ctx->dev, 0);
+	nvm_stub_conf.read_fail_every = 0;
+
+	return n;
+}
+
+static long b_for_each_line(struct bench_ctx *ctx)
+{
+	struct for_each_conf fec;
+
+	fec_init(ctx, &fec, 0);
+	report_clear(ctx);
+	for_each_line(ctx->dev, ctx->geo, &fec, 0x7, (void *)ctx->report);
+	failmap_reset(&ctx->fails);
+
+	return (long)ctx->max_ch * ctx->max_lun * ctx->max_blk;
+}
+
+static long b_print_stats(struct bench_ctx *ctx, int fill)
+{
+	const struct nvm_geo *geo = ctx->geo;
+	int (*report)[geo->nluns][geo->nblocks] = (void *)ctx->report;
+
+	report_clear(ctx);
+	if (fill)
+		for (int ch = 0; ch < ctx->max_ch; ch++)
+			for (int lun = 0; lun < ctx->max_lun; lun++)
+				for (int blk = 0; blk < ctx->max_blk; blk++)
+					report[ch][lun][blk] = 0x1000 | (blk & 0xfff);
+
+	print_statistics(geo, ctx->max_ch, ctx->max_lun, ctx->max_blk, 0,
+								report);
+
+	return (long)ctx->max_ch * ctx->max_lun * ctx->max_blk;
+}
+
+static long b_print_stats_sparse(struct bench_ctx *ctx)
+{
+	return b_print_stats(ctx, 0);
+}
+
+static long b_print_stats_dense(struct bench_ctx *ctx)
+{
+	return b_print_stats(ctx, 1);
+}
+
+/* sparse failures, a few sectors every few pages */
+static void s_runmap(struct bench_ctx *ctx)
+{
+	const struct nvm_geo *geo = ctx->geo;
+	uint32_t naddrs = geo->nplanes * geo->nsectors;
+
+	for (int m = 0; m < 2; m++) {
+		runmap_free(&ctx->maps[m]);
+		for (uint32_t pg = m; pg < geo->npages; pg += 3)
+			runmap_add_range(&ctx->maps[m], pg * naddrs + m, 2);
+	}
+}
+
+static long b_runmap_add(struct bench_ctx *ctx)
+{
+	const struct nvm_geo *geo = ctx->geo;
+	uint32_t naddrs = geo->nplanes * geo->nsectors;
+	struct runmap m = RUNMAP_INIT;
+
+	for (uint32_t pg = 0; pg < geo->npages; pg++)
+		runmap_add(&m, pg * naddrs + (pg & 3));
+	runmap_free(&m);
+
+	return geo->npages;
+}
+
+static long b_runmap_union(struct bench_ctx *ctx)
+{
+	struct runmap m = RUNMAP_INIT;
+
+	runmap_union(&m, &ctx->maps[0], &ctx->maps[1]);
+	runmap_free(&m);
+
+	return 1;
+}
+
+static long b_runmap_intersect(struct bench_ctx *ctx)
+{
+	struct runmap m = RUNMAP_INIT;
+
+	runmap_intersect(&m, &ctx->maps[0], &ctx->maps[1]);
+	runmap_free(&m);
+
+	return 1;
+}
+
+static long bytes_per_pg(const struct nvm_geo *geo)
+{
+	return geo->nplanes * geo->nsectors * geo->sector_nbytes;
+}
+
+#define POOL_MB 64
+#define BIG_MB 64
+
+/* map, fault in and unmap a pool, the setup cost paid per run */
+static long b_bufpool_create(struct bench_ctx *ctx)
+{
+	struct bufpool *pool = bufpool_create(POOL_MB << 20, ctx->hugepages);
+
+	if (!pool)
+		return 0;
+	bufpool_destroy(pool);
+
+	return POOL_MB;
+}
+
+static void s_bufpool_copy(struct bench_ctx *ctx)
+{
+	if (!ctx->big)
+		ctx->big = bufpool_create((size_t)BIG_MB << 20, ctx->hugepages);
+}
+
+/*
+ * Copy page groups in and out of random slots of a large pool, the access
+ * pattern of many commands in flight with the device moving the payload.
+ */
+static long b_bufpool_copy(struct bench_ctx *ctx)
+{
+	static char tmp[1 << 20] __attribute__((aligned(4096)));
+	size_t nbytes = bytes_per_pg(ctx->geo);
+	size_t nslots;
+	static unsigned int seed = 1;
+
+	if (!ctx->big || nbytes > sizeof(tmp))
+		return 0;
+
+	nslots = ctx->big->nbytes / nbytes;
+	for (int i = 0; i < 1024; i++) {
+		char *slot = ctx->big->base + (rand_r(&seed) % nslots) * nbytes;
+
+		if (i & 1)
+			memcpy(tmp, slot, nbytes);
+		else
+			memcpy(slot, tmp, nbytes);
+	}
+
+	return 1024;
+}
+
+static long cmds_pages(const struct nvm_geo *geo)
+{
+	return geo->npages;
+}
+
+static long cmds_one(const struct nvm_geo *geo)
+{
+	return 1;
+}
+
+static long bytes_blk(const struct nvm_geo *geo)
+{
+	return geo->npages * geo->nplanes * geo->nsectors * geo->sector_nbytes;
+}
+
+static long bytes_mb(const struct nvm_geo *geo)
+{
+	return 1L << 20;
+}
+
+static const struct bench benches[] = {
+	{"rw_blk.write", "blk", NULL, b_rw_blk_write, cmds_pages, bytes_blk},
+	{"rw_blk.read", "blk", NULL, b_rw_blk_read, cmds_pages, bytes_blk},
+	{"rw_blk.read_timed", "blk", NULL, b_rw_blk_read_timed, cmds_pages, bytes_blk},
+	{"rw_blk.read_retry", "blk", NULL, b_rw_blk_read_retry, cmds_pages, bytes_blk},
+	{"erase_blk", "blk", NULL, b_erase_blk, cmds_one, NULL},
+	{"for_each_blk.read", "blk", s_for_each_write, b_for_each_read, cmds_pages, bytes_blk},
+	{"for_each_blk.read_fail", "blk", s_for_each_write, b_for_each_read_fail, cmds_pages, bytes_blk},
+	{"for_each_blk.read_progress", "blk", s_for_each_write, b_for_each_read_progress, cmds_pages, bytes_blk},
+	{"for_each_blk.read_profile", "blk", s_for_each_write, b_for_each_read_profile, cmds_pages, bytes_blk},
+	{"for_each_blk.erase", "blk", NULL, b_for_each_erase, cmds_one, NULL},
+	{"for_each_blk.bbt_skip", "blk", NULL, b_for_each_bbt_skip, NULL, NULL},
+	{"for_each_blk.weak_lun", "blk", NULL, b_for_each_weak_lun_plain, NULL, NULL},
+	{"for_each_blk.weak_lun_adapt", "blk", NULL, b_for_each_weak_lun_adapt, NULL, NULL},
+	{"for_each_line", "blk", NULL, b_for_each_line, NULL, bytes_blk},
+	{"print_statistics.sparse", "blk", NULL, b_print_stats_sparse, NULL, NULL},
+	{"print_statistics.dense", "blk", NULL, b_print_stats_dense, NULL, NULL},
+	{"runmap.add", "bit", NULL, b_runmap_add, NULL, NULL},
+	{"runmap.union", "blk", s_runmap, b_runmap_union, NULL, NULL},
+	{"runmap.intersect", "blk", s_runmap, b_runmap_intersect, NULL, NULL},
+	{"bufpool.create", "MB", NULL, b_bufpool_create, NULL, bytes_mb},
+	{"bufpool.copy", "pg", s_bufpool_copy, b_bufpool_copy, NULL, bytes_per_pg},
+	{NULL}
+};
+
+static void run_bench(const struct bench *b, struct bench_ctx *ctx,
+						struct bench_args *args)
+{
+	double wall[args->reps], cpu[args->reps];
+	long iters = 1, units = 0;
+	double t;
+
+	if (b->setup)
+		b->setup(ctx);
+
+	/* calibrate: grow iterations until one repetition takes min_ms */
+	for (;;) {
+		t = now_ns(CLOCK_MONOTONIC);
+		for (long i = 0; i < iters; i++)
+			b->fn(ctx);
+		t = now_ns(CLOCK_MONOTONIC) - t;
+		if (t >= args->min_ms * 1e6 || iters >= (1L << 30))
+			break;
+		iters *= 2;
+	}
+
+	for (int r = 0; r < args->reps; r++) {
+		double w = now_ns(CLOCK_MONOTONIC);
+		double c = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+		units = 0;
+		for (long i = 0; i < iters; i++)
+			units += b->fn(ctx);
+
+		wall[r] = (now_ns(CLOCK_MONOTONIC) - w) / units;
+		cpu[r] = (now_ns(CLOCK_PROCESS_CPUTIME_ID) - c) / units;
+	}
+
+	qsort(wall, args->reps, sizeof(double), cmp_double);
+	qsort(cpu, args->reps, sizeof(double), cmp_double);
+
+	fprintf(out, "{\"bench\":\"%s\",\"unit\":\"%s\",\"reps\":%d,"
+		"\"units_per_rep\":%ld,\"ns_per_unit_min\":%.1f,"
+		"\"ns_per_unit_median\":%.1f,\"cpu_ns_per_unit_median\":%.1f",
+		b->name, b->unit, args->reps, units, wall[0],
+		wall[args->reps / 2], cpu[args->reps / 2]);
+	if (b->cmds_per_unit)
+		fprintf(out, ",\"ns_per_cmd_median\":%.2f",
+			wall[args->reps / 2] / b->cmds_per_unit(ctx->geo));
+	if (b->bytes_per_unit)
+		fprintf(out, ",\"cpu_ms_per_gb\":%.3f",
+			cpu[args->reps / 2] * 1e-6 * (1UL << 30) /
+						b->bytes_per_unit(ctx->geo));
+	fprintf(out, "}\n");
+	fflush(out);
+}
+
+static struct argp_option opt_bench[] =
+{
+	{"reps", 'r', "reps", 0, "Repetitions per benchmark (default 5)"},
+	{"mintime", 't', "ms", 0, "Minimum duration of one repetition (default 100)"},
+	{"filter", 'f', "prefix", 0, "Only run benchmarks whose name starts with prefix"},
+	{"maxblk", 'b', "max_blk", 0, "Blocks per LUN touched per iteration (default 16)"},
+	{"channels", 'c', "nchannels", 0, "Stub geometry: channels"},
+	{"luns", 'l', "nluns", 0, "Stub geometry: LUNs per channel"},
+	{"planes", 'p', "nplanes", 0, "Stub geometry: planes"},
+	{"blocks", 'k', "nblocks", 0, "Stub geometry: blocks per LUN"},
+	{"pages", 'g', "npages", 0, "Stub geometry: pages per block"},
+	{"sectors", 's', "nsectors", 0, "Stub geometry: sectors per page"},
+	{"hugepages", 'H', "SIZE", 0, "Back I/O buffers with 1g, 2m, thp or none (default)"},
+	{"touch", 'T', 0, 0, "Have the stub copy the payload of every command"},
+	{"generic", 'G', 0, 0, "Take the generic I/O path even where the geometry has a specialized one"},
+	{0}
+};
+
+static error_t parse_bench_opt(int key, char *arg, struct argp_state *state)
+{
+	struct bench_args *args = state->input;
+
+	switch (key) {
+	case 'r':
+		args->reps = atoi(arg);
+		break;
+	case 't':
+		args->min_ms = atoi(arg);
+		break;
+	case 'f':
+		args->filter = arg;
+		break;
+	case 'b':
+		args->max_blk = atoi(arg);
+		break;
+	case 'c':
+		args->geo.nchannels = atoi(arg);
+		break;
+	case 'l':
+		args->geo.nluns = atoi(arg);
+		break;
+	case 'p':
+		args->geo.nplanes = atoi(arg);
+		break;
+	case 'k':
+		args->geo.nblocks = atoi(arg);
+		break;
+	case 'g':
+		args->geo.npages = atoi(arg);
+		break;
+	case 's':
+		args->geo.nsectors = atoi(arg);
+		break;
+	case 'H':
+		args->hugepages = bufpool_parse(arg);
+		if (args->hugepages < 0)
+			argp_usage(state);
+		break;
+	case 'T':
+		args->touch = 1;
+		break;
+	case 'G':
+		args->generic = 1;
+		break;
+	case ARGP_KEY_END:
+		if (args->reps < 1 || args->min_ms < 1 || args->max_blk < 1)
+			argp_usage(state);
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp argp_bench = {opt_bench, parse_bench_opt, 0,
+		"Host-side microbenchmarks for lnvm-tool against a stubbed device."};
+
+int main(int argc, char **argv)
+{
+	struct bench_args args = {
+		.reps = 5,
+		.min_ms = 100,
+		.max_blk = 16,
+		.geo = nvm_stub_conf.geo,
+	};
+	struct bench_ctx ctx;
+	const struct nvm_geo *geo;
+
+	memset(&ctx, 0, sizeof(ctx));
+	argp_parse(&argp_bench, argc, argv, 0, NULL, &args);
+
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	if (!out || !freopen("/dev/null", "w", stdout)) {
+		perror("Could not redirect output");
+		return 1;
+	}
+
+	nvm_stub_conf.geo = args.geo;
+	nvm_stub_conf.touch_data = args.touch;
+	ctx.dev = nvm_dev_open("stub");
+	nvm_stub_conf.bad_blk_every = 1;
+	ctx.bad_dev = nvm_dev_open("stub");
+	nvm_stub_conf.bad_blk_every = 0;
+	if (!ctx.dev || !ctx.bad_dev) {
+		fprintf(stderr, "Could not open stub device.\n");
+		return 1;
+	}
+	geo = ctx.geo = nvm_dev_get_geo(ctx.dev);
+
+	ctx.max_ch = geo->nchannels;
+	ctx.max_lun = geo->nluns;
+	ctx.max_blk = args.max_blk < geo->nblocks ? args.max_blk : geo->nblocks;
+	ctx.report = calloc(geo->nchannels * geo->nluns * geo->nblocks,
+								sizeof(int));
+	ctx.kept = malloc(geo->nchannels * geo->nluns * geo->nblocks);
+	ctx.hugepages = args.hugepages;
+	ctx.big = NULL;
+	if (io_bufs_init(geo, &ctx.bufs, geo->nchannels * geo->nluns, args.hugepages)) {
+		fprintf(stderr, "Could not allocate I/O buffers.\n");
+		return 1;
+	}
+	oob_init(geo, &ctx.oob, 0, 0);
+	oob_next_pass(&ctx.oob);
+	/* no backoff, the retry path is measured rather than the sleep */
+	ctx.io.retries = 1;
+	ctx.io.backoff_us = 0;
+	ctx.io.nluns = geo->nluns;
+	ctx.io.layout = args.generic ? IO_LAYOUT_ANY : io_layout(geo);
+	ctx.io.sector_nbytes = geo->sector_nbytes;
+	ctx.io.stats = calloc(geo->nchannels * geo->nluns, sizeof(struct io_stats));
+	memset(&ctx.fails, 0, sizeof(ctx.fails));
+	ctx.fails.nluns = geo->nchannels * geo->nluns;
+	memset(ctx.maps, 0, sizeof(ctx.maps));
+	if (!ctx.report || !ctx.io.stats) {
+		fprintf(stderr, "Could not allocate buffers.\n");
+		return 1;
+	}
+
+	fprintf(out, "{\"meta\":\"lnvm-bench\",\"version\":\"%s\","
+		"\"threads\":%d,\"nchannels\":%zu,\"nluns\":%zu,"
+		"\"nplanes\":%zu,\"nblocks\":%zu,\"npages\":%zu,"
+		"\"nsectors\":%zu,\"sector_nbytes\":%zu,\"max_blk\":%d,"
+		"\"touch\":%d,\"iobuf\":\"%s\",\"iobuf_want\":\"%s\","
+		"\"iobuf_fallback\":\"%s\",\"io_path\":\"%s\"}\n",
+		argp_program_version, omp_get_max_threads(), geo->nchannels,
+		geo->nluns, geo->nplanes, geo->nblocks, geo->npages,
+		geo->nsectors, geo->sector_nbytes, ctx.max_blk, args.touch,
+		bufpool_backing_name(ctx.bufs.pool->backing),
+		bufpool_backing_name(args.hugepages),
+		bufpool_fallback_name(ctx.bufs.pool->fallback), layout_name[ctx.io.layout]);
+
+	for (const struct bench *b = benches; b->name; b++) {
+		if (args.filter && strncmp(b->name, args.filter,
+							strlen(args.filter)))
+			continue;
+		run_bench(b, &ctx, &args);
+	}
+
+	runmap_free(&ctx.maps[0]);
+	runmap_free(&ctx.maps[1]);
+	free(ctx.io.stats);
+	bufpool_destroy(ctx.big);
+	io_bufs_free(&ctx.bufs);
+	free(ctx.report);
+	free(ctx.kept);
+	nvm_dev_close(ctx.bad_dev);
+	nvm_dev_close(ctx.dev);
+	fclose(out);
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Stand-in for <liblightnvm.h> used by lnvm-bench.
+ *
+ * Declares only the subset of the liblightnvm API that lnvm-tool uses, with
+ * the same types and signatures, so lnvm.c can be compiled unmodified against
+ * the stubbed I/O in nvm_stub.c. No device or library is needed.
+ */
+#ifndef __LIBLIGHTNVM_STUB_H
+#define __LIBLIGHTNVM_STUB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct nvm_dev;
+
+struct nvm_geo {
+	size_t nchannels;
+	size_t nluns;
+	size_t nplanes;
+	size_t nblocks;
+	size_t npages;
+	size_t nsectors;
+	size_t nbytes;
+
+	size_t tbytes;
+
+	size_t sector_nbytes;
+	size_t page_nbytes;
+	size_t meta_nbytes;
+
+	size_t vblk_nbytes;
+	size_t vpg_nbytes;
+};
+
+struct nvm_addr {
+	union {
+		struct {
+			uint64_t blk	: 16;
+			uint64_t pg	: 16;
+			uint64_t sec	: 8;
+			uint64_t pl	: 8;
+			uint64_t lun	: 8;
+			uint64_t ch	: 7;
+			uint64_t rsvd	: 1;
+		} g;
+
+		uint64_t ppa;
+	};
+};
+
+struct nvm_ret {
+	uint64_t result;
+	uint16_t status;
+};
+
+struct nvm_bbt {
+	struct nvm_addr addr;
+	uint64_t nblks;
+	uint8_t *blks;
+};
+
+struct nvm_dev *nvm_dev_open(const char *dev_path);
+void nvm_dev_close(struct nvm_dev *dev);
+void nvm_dev_pr(struct nvm_dev *dev);
+const struct nvm_geo *nvm_dev_get_geo(struct nvm_dev *dev);
+
+void nvm_geo_pr(const struct nvm_geo *geo);
+
+void *nvm_buf_alloc(const struct nvm_geo *geo, size_t nbytes);
+
+ssize_t nvm_addr_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
+		       int naddrs, uint16_t flags, struct nvm_ret *ret);
+ssize_t nvm_addr_write(struct nvm_dev *dev, struct nvm_addr addrs[],
+		       int naddrs, const void *data, const void *meta,
+		       uint16_t flags, struct nvm_ret *ret);
+ssize_t nvm_addr_read(struct nvm_dev *dev, struct nvm_addr addrs[],
+		      int naddrs, void *data, void *meta, uint16_t flags,
+		      struct nvm_ret *ret);
+void nvm_addr_pr(struct nvm_addr addr);
+
+const struct nvm_bbt *nvm_bbt_get(struct nvm_dev *dev, struct nvm_addr addr,
+				  struct nvm_ret *ret);
+int nvm_bbt_mark(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		 uint16_t flags, struct nvm_ret *ret);
+struct nvm_bbt *nvm_bbt_alloc_cp(const struct nvm_bbt *bbt);
+void nvm_bbt_free(struct nvm_bbt *bbt);
+
+void nvm_ret_pr(struct nvm_ret *ret);
+
+#endif /* __LIBLIGHTNVM_STUB_H */
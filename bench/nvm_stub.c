@@ -0,0 +1,368 @@
+/*
+ * Stubbed liblightnvm for lnvm-bench.
+ *
+ * Every I/O call completes immediately. OOB metadata is kept per sector so it
+ * reads back as written. Commands can optionally touch the payload and fail
+ * at a fixed rate, so the host-side paths in lnvm.c run the same way they
+ * would against a device, minus the device.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "nvm_stub.h"
+
+struct nvm_dev {
+	struct nvm_geo geo;
+	struct nvm_bbt *bbts;	/* nchannels * nluns, built at open */
+	char **meta;		/* per block OOB, allocated on first write */
+};
+
+struct nvm_stub_conf nvm_stub_conf = {
+	.geo = {
+		.nchannels = 16,
+		.nluns = 8,
+		.nplanes = 4,
+		.nblocks = 1067,
+		.npages = 256,
+		.nsectors = 4,
+		.sector_nbytes = 4096,
+		.meta_nbytes = 16,
+	},
+};
+
+static unsigned long ncmds;
+static __thread void *scratch;
+static __thread size_t scratch_nbytes;
+
+unsigned long nvm_stub_ncmds(void)
+{
+	return __atomic_load_n(&ncmds, __ATOMIC_RELAXED);
+}
+
+static void stub_fill_geo(struct nvm_geo *geo)
+{
+	geo->page_nbytes = geo->nsectors * geo->sector_nbytes;
+	geo->vpg_nbytes = geo->page_nbytes * geo->nplanes;
+	geo->vblk_nbytes = geo->vpg_nbytes * geo->npages;
+	geo->nbytes = geo->page_nbytes;
+	geo->tbytes = geo->vblk_nbytes * geo->nblocks * geo->nluns *
+							geo->nchannels;
+}
+
+struct nvm_dev *nvm_dev_open(const char *dev_path)
+{
+	struct nvm_dev *dev;
+	struct nvm_geo *geo;
+	size_t nblks;
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return NULL;
+
+	dev->geo = nvm_stub_conf.geo;
+	geo = &dev->geo;
+	stub_fill_geo(geo);
+
+	nblks = geo->nblocks * geo->nplanes;
+	dev->bbts = calloc(geo->nchannels * geo->nluns, sizeof(*dev->bbts));
+	dev->meta = calloc(geo->nchannels * geo->nluns * geo->nblocks,
+							sizeof(*dev->meta));
+	if (!dev->bbts || !dev->meta) {
+		nvm_dev_close(dev);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < geo->nchannels * geo->nluns; i++) {
+		struct nvm_bbt *bbt = &dev->bbts[i];
+
+		bbt->addr.ppa = 0;
+		bbt->addr.g.ch = i / geo->nluns;
+		bbt->addr.g.lun = i % geo->nluns;
+		bbt->nblks = nblks;
+		bbt->blks = calloc(nblks, 1);
+		if (!bbt->blks) {
+			nvm_dev_close(dev);
+			return NULL;
+		}
+
+		if (!nvm_stub_conf.bad_blk_every)
+			continue;
+		for (size_t blk = 0; blk < geo->nblocks; blk++)
+			if ((blk + i) % nvm_stub_conf.bad_blk_every == 0)
+				bbt->blks[blk * geo->nplanes] = 0x1;
+	}
+
+	return dev;
+}
+
+void nvm_dev_close(struct nvm_dev *dev)
+{
+	if (!dev)
+		return;
+
+	for (size_t i = 0; dev->bbts && i < dev->geo.nchannels * dev->geo.nluns; i++)
+		free(dev->bbts[i].blks);
+	for (size_t i = 0; dev->meta && i < dev->geo.nchannels * dev->geo.nluns *
+						dev->geo.nblocks; i++)
+		free(dev->meta[i]);
+	free(dev->meta);
+	free(dev->bbts);
+	free(dev);
+}
+
+void nvm_dev_pr(struct nvm_dev *dev)
+{
+	printf("dev { stub }\n");
+}
+
+const struct nvm_geo *nvm_dev_get_geo(struct nvm_dev *dev)
+{
+	return &dev->geo;
+}
+
+void nvm_geo_pr(const struct nvm_geo *geo)
+{
+	printf("geo { nchannels(%zu), nluns(%zu), nplanes(%zu), nblocks(%zu), "
+	       "npages(%zu), nsectors(%zu), sector_nbytes(%zu) }\n",
+	       geo->nchannels, geo->nluns, geo->nplanes, geo->nblocks,
+	       geo->npages, geo->nsectors, geo->sector_nbytes);
+}
+
+void *nvm_buf_alloc(const struct nvm_geo *geo, size_t nbytes)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, 4096, nbytes))
+		return NULL;
+	memset(buf, 0, nbytes);
+
+	return buf;
+}
+
+static void *stub_scratch(size_t nbytes)
+{
+	if (scratch_nbytes < nbytes) {
+		free(scratch);
+		scratch = malloc(nbytes);
+		scratch_nbytes = scratch ? nbytes : 0;
+	}
+
+	return scratch;
+}
+
+static char *stub_meta_blk(struct nvm_dev *dev, struct nvm_addr addr,
+								int alloc)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	char **slot = &dev->meta[(addr.g.ch * geo->nluns + addr.g.lun) *
+						geo->nblocks + addr.g.blk];
+	char *blk = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	size_t nbytes = geo->npages * geo->nplanes * geo->nsectors *
+							geo->meta_nbytes;
+
+	if (blk || !alloc)
+		return blk;
+
+	blk = malloc(nbytes);
+	if (!blk)
+		return NULL;
+	memset(blk, 0xff, nbytes);
+
+	if (!__atomic_compare_exchange_n(slot, &(char *){NULL}, blk, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(blk);
+		blk = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	}
+
+	return blk;
+}
+
+static size_t stub_meta_off(const struct nvm_geo *geo, struct nvm_addr addr)
+{
+	return ((addr.g.pg * geo->nplanes + addr.g.pl) * geo->nsectors +
+					addr.g.sec) * geo->meta_nbytes;
+}
+
+static void stub_meta_write(struct nvm_dev *dev, struct nvm_addr addrs[],
+					int naddrs, const char *meta)
+{
+	for (int i = 0; i < naddrs; i++) {
+		char *blk = stub_meta_blk(dev, addrs[i], 1);
+
+		if (blk)
+			memcpy(blk + stub_meta_off(&dev->geo, addrs[i]),
+			       meta + i * dev->geo.meta_nbytes,
+			       dev->geo.meta_nbytes);
+	}
+}
+
+static void stub_meta_read(struct nvm_dev *dev, struct nvm_addr addrs[],
+					int naddrs, char *meta)
+{
+	for (int i = 0; i < naddrs; i++) {
+		char *blk = stub_meta_blk(dev, addrs[i], 0);
+		char *dst = meta + i * dev->geo.meta_nbytes;
+
+		if (blk)
+			memcpy(dst, blk + stub_meta_off(&dev->geo, addrs[i]),
+			       dev->geo.meta_nbytes);
+		else
+			memset(dst, 0xff, dev->geo.meta_nbytes);
+	}
+}
+
+/* an erased block reads back as all 0xff, same as one never written */
+static void stub_meta_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
+								int naddrs)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	struct nvm_addr addr = addrs[0];
+
+	free(__atomic_exchange_n(&dev->meta[(addr.g.ch * geo->nluns +
+			addr.g.lun) * geo->nblocks + addr.g.blk], NULL,
+			__ATOMIC_ACQ_REL));
+}
+
+/* status codes as the device reports them, DNR bit included */
+#define STUB_SC_FAILWRITE	0x40ff
+#define STUB_SC_FAILECC		0x4281
+
+static ssize_t stub_complete(int every, uint64_t fail_result,
+							struct nvm_ret *ret)
+{
+	unsigned long n = __atomic_add_fetch(&ncmds, 1, __ATOMIC_RELAXED);
+	int timeout = nvm_stub_conf.timeout_every &&
+					n % nvm_stub_conf.timeout_every == 0;
+	int fail = every && n % every == 0;
+
+	if (ret) {
+		ret->result = fail && !timeout ? fail_result : 0;
+		ret->status = 0;
+	}
+	if (timeout) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	if (fail) {
+		errno = EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
+ssize_t nvm_addr_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
+		       int naddrs, uint16_t flags, struct nvm_ret *ret)
+{
+	int every = nvm_stub_conf.erase_fail_every;
+
+	if (nvm_stub_conf.weak_lun && naddrs &&
+	    addrs[0].g.ch * dev->geo.nluns + addrs[0].g.lun + 1 ==
+						(uint64_t)nvm_stub_conf.weak_lun)
+		every = 1;
+
+	stub_meta_erase(dev, addrs, naddrs);
+
+	return stub_complete(every, STUB_SC_FAILWRITE, ret);
+}
+
+ssize_t nvm_addr_write(struct nvm_dev *dev, struct nvm_addr addrs[],
+		       int naddrs, const void *data, const void *meta,
+		       uint16_t flags, struct nvm_ret *ret)
+{
+	if (nvm_stub_conf.touch_data) {
+		size_t nbytes = naddrs * dev->geo.sector_nbytes;
+		void *dst = stub_scratch(nbytes);
+
+		if (dst)
+			memcpy(dst, data, nbytes);
+	}
+	if (meta)
+		stub_meta_write(dev, addrs, naddrs, meta);
+
+	return stub_complete(nvm_stub_conf.write_fail_every, STUB_SC_FAILWRITE,
+								ret);
+}
+
+ssize_t nvm_addr_read(struct nvm_dev *dev, struct nvm_addr addrs[],
+		      int naddrs, void *data, void *meta, uint16_t flags,
+		      struct nvm_ret *ret)
+{
+	if (nvm_stub_conf.touch_data) {
+		size_t nbytes = naddrs * dev->geo.sector_nbytes;
+		void *src = stub_scratch(nbytes);
+
+		if (src)
+			memcpy(data, src, nbytes);
+	}
+	if (meta)
+		stub_meta_read(dev, addrs, naddrs, meta);
+
+	return stub_complete(nvm_stub_conf.read_fail_every, STUB_SC_FAILECC,
+								ret);
+}
+
+void nvm_addr_pr(struct nvm_addr addr)
+{
+	printf("(%016lx){ ch(%02d), lun(%02d), pl(%d), blk(%04d), pg(%03d), "
+	       "sec(%d) }\n", (unsigned long)addr.ppa, (int)addr.g.ch,
+	       (int)addr.g.lun, (int)addr.g.pl, (int)addr.g.blk,
+	       (int)addr.g.pg, (int)addr.g.sec);
+}
+
+const struct nvm_bbt *nvm_bbt_get(struct nvm_dev *dev, struct nvm_addr addr,
+				  struct nvm_ret *ret)
+{
+	if (ret)
+		ret->result = ret->status = 0;
+
+	return &dev->bbts[addr.g.ch * dev->geo.nluns + addr.g.lun];
+}
+
+int nvm_bbt_mark(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		 uint16_t flags, struct nvm_ret *ret)
+{
+	if (ret)
+		ret->result = ret->status = 0;
+
+	return 0;
+}
+
+struct nvm_bbt *nvm_bbt_alloc_cp(const struct nvm_bbt *bbt)
+{
+	struct nvm_bbt *cp;
+
+	if (!bbt)
+		return NULL;
+
+	cp = malloc(sizeof(*cp));
+	if (!cp)
+		return NULL;
+
+	*cp = *bbt;
+	cp->blks = malloc(bbt->nblks);
+	if (!cp->blks) {
+		free(cp);
+		return NULL;
+	}
+	memcpy(cp->blks, bbt->blks, bbt->nblks);
+
+	return cp;
+}
+
+void nvm_bbt_free(struct nvm_bbt *bbt)
+{
+	if (!bbt)
+		return;
+
+	free(bbt->blks);
+	free(bbt);
+}
+
+void nvm_ret_pr(struct nvm_ret *ret)
+{
+	printf("ret { result(0x%lx), status(%u) }\n",
+	       (unsigned long)ret->result, ret->status);
+}
@@ -0,0 +1,27 @@
+#ifndef NVM_STUB_H_
+#define NVM_STUB_H_
+
+#include <liblightnvm.h>
+
+/*
+ * Knobs for the stubbed device. Set before nvm_dev_open(); the geometry is
+ * copied into the device at open time.
+ */
+struct nvm_stub_conf {
+	struct nvm_geo geo;
+
+	int bad_blk_every;	/* mark every Nth block bad in the BBT, 0 off */
+	int read_fail_every;	/* fail every Nth read command, 0 off */
+	int write_fail_every;	/* fail every Nth write command, 0 off */
+	int erase_fail_every;	/* fail every Nth erase command, 0 off */
+	int timeout_every;	/* time out every Nth command of any kind */
+	int weak_lun;		/* ch * nluns + lun + 1 of a LUN failing every erase, 0 off */
+	int touch_data;		/* copy payload on read/write like a device */
+};
+
+extern struct nvm_stub_conf nvm_stub_conf;
+
+/* Commands issued against the stub since start, for sanity checks. */
+unsigned long nvm_stub_ncmds(void);
+
+#endif
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "bufpool.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#define SZ_2M (2UL << 20)
+#define SZ_1G (1UL << 30)
+
+static const char *backing_name[] = { "4k", "thp", "hugetlb-2m", "hugetlb-1g" };
+static const char *fallback_name[] = { "none", "too large for the pool", "not available" };
+
+const char *bufpool_backing_name(int backing)
+{
+	return backing_name[backing];
+}
+
+const char *bufpool_fallback_name(int fallback)
+{
+	return fallback_name[fallback];
+}
+
+int bufpool_parse(const char *s)
+{
+	if (!strcasecmp(s, "1g"))
+		return BUFPOOL_HUGETLB_1G;
+	if (!strcasecmp(s, "2m"))
+		return BUFPOOL_HUGETLB_2M;
+	if (!strcasecmp(s, "thp"))
+		return BUFPOOL_THP;
+	if (!strcasecmp(s, "none") || !strcasecmp(s, "4k"))
+		return BUFPOOL_PAGES;
+
+	return -1;
+}
+
+static size_t backing_page(int backing)
+{
+	switch (backing) {
+	case BUFPOOL_HUGETLB_1G:
+		return SZ_1G;
+	case BUFPOOL_HUGETLB_2M:
+	case BUFPOOL_THP:
+		return SZ_2M;
+	default:
+		return sysconf(_SC_PAGESIZE);
+	}
+}
+
+static int thp_enabled(void)
+{
+	char buf[128] = { 0 };
+	FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+
+	if (!fp)
+		return 0;
+	if (!fgets(buf, sizeof(buf), fp))
+		buf[0] = '\0';
+	fclose(fp);
+
+	return !strstr(buf, "[never]");
+}
+
+/* hugetlb reserves at mmap time, so a short pool fails here, not on fault */
+static void *map_hugetlb(size_t nbytes, int shift)
+{
+	void *p = mmap(NULL, nbytes, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE | (shift << MAP_HUGE_SHIFT), -1, 0);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+/* THP only backs 2M aligned ranges, so map a bit more and trim */
+static void *map_thp(size_t nbytes)
+{
+	char *p, *base;
+	size_t head;
+
+	p = mmap(NULL, nbytes + SZ_2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	base = (char *)(((unsigned long)p + SZ_2M - 1) & ~(SZ_2M - 1));
+	head = base - p;
+	if (head)
+		munmap(p, head);
+	munmap(base + nbytes, SZ_2M - head);
+
+	if (madvise(base, nbytes, MADV_HUGEPAGE)) {
+		munmap(base, nbytes);
+		return NULL;
+	}
+	memset(base, 0, nbytes);	/* fault in after the advice */
+
+	return base;
+}
+
+static void *map_pages(size_t nbytes)
+{
+	void *p = mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+struct bufpool *bufpool_create(size_t nbytes, int want)
+{
+	struct bufpool *pool;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+	pool->want = want;
+
+	for (int backing = want; backing >= BUFPOOL_PAGES; backing--) {
+		size_t page = backing_page(backing);
+		size_t len = (nbytes + page - 1) & ~(page - 1);
+
+		/* not worth more than doubling the pool for */
+		if (backing != BUFPOOL_PAGES && len > 2 * nbytes) {
+			if (backing == want)
+				pool->fallback = BUFPOOL_FALLBACK_SIZE;
+			continue;
+		}
+
+		switch (backing) {
+		case BUFPOOL_HUGETLB_1G:
+			pool->base = map_hugetlb(len, 30);
+			break;
+		case BUFPOOL_HUGETLB_2M:
+			pool->base = map_hugetlb(len, 21);
+			break;
+		case BUFPOOL_THP:
+			pool->base = thp_enabled() ? map_thp(len) : NULL;
+			break;
+		default:
+			pool->base = map_pages(len);
+			break;
+		}
+
+		if (pool->base) {
+			pool->nbytes = len;
+			pool->backing = backing;
+			return pool;
+		}
+		if (backing == want)
+			pool->fallback = BUFPOOL_FALLBACK_MAP;
+	}
+
+	free(pool);
+	return NULL;
+}
+
+void bufpool_destroy(struct bufpool *pool)
+{
+	if (!pool)
+		return;
+
+	munmap(pool->base, pool->nbytes);
+	free(pool);
+}
+
+void *bufpool_get(struct bufpool *pool, size_t nbytes, size_t align)
+{
+	size_t off = (pool->used + align - 1) & ~(align - 1);
+
+	if (off + nbytes > pool->nbytes)
+		return NULL;
+
+	pool->used = off + nbytes;
+	return pool->base + off;
+}
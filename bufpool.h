@@ -0,0 +1,48 @@
+#ifndef BUFPOOL_H_
+#define BUFPOOL_H_
+
+#include <stddef.h>
+
+/*
+ * I/O buffers carved from one prefaulted mapping. Backing a large pool with
+ * huge pages cuts TLB misses and the per-page cost of faulting in and
+ * pinning buffers for every command. The backing asked for is a
+ * preference: creation falls back to the next smaller kind the system can
+ * provide, and the pool records what it got.
+ */
+enum bufpool_backing {
+	BUFPOOL_PAGES = 0,
+	BUFPOOL_THP = 1,		/* madvised, the kernel may still split */
+	BUFPOOL_HUGETLB_2M = 2,
+	BUFPOOL_HUGETLB_1G = 3,
+};
+
+/* why the backing asked for was not used */
+enum bufpool_fallback {
+	BUFPOOL_FALLBACK_NONE = 0,
+	BUFPOOL_FALLBACK_SIZE = 1,	/* rounding up would more than double the pool */
+	BUFPOOL_FALLBACK_MAP = 2,	/* not enabled, reserved or mappable */
+};
+
+struct bufpool {
+	char *base;
+	size_t nbytes;		/* mapped, rounded up to the page size */
+	size_t used;
+	int want;
+	int backing;
+	int fallback;
+};
+
+struct bufpool *bufpool_create(size_t nbytes, int want);
+void bufpool_destroy(struct bufpool *pool);
+
+/* align must be a power of two; NULL once the pool is used up */
+void *bufpool_get(struct bufpool *pool, size_t nbytes, size_t align);
+
+const char *bufpool_backing_name(int backing);
+const char *bufpool_fallback_name(int fallback);
+
+/* "1g", "2m", "thp" or "none", -1 if unknown */
+int bufpool_parse(const char *s);
+
+#endif
@@ -1,6 +1,209 @@
 #include "lnvm.h"
+#include "runmap.h"
+#include "progress.h"
+#include "archive.h"
+#include "bufpool.h"
+#include "prof.h"
 #include <omp.h>
+#include <math.h>
 #include <sys/time.h>
+#include <time.h>
+
+/*
+ * Per-sector out-of-band signature. Stamped into the OOB area of every sector
+ * on write and checked on read, which catches misdirected and stale reads
+ * without comparing the payload.
+ */
+#define OOB_SIG_MAGIC 0x4c4e
+
+struct oob_sig {
+	uint64_t ppa;
+	uint32_t seq;
+	uint16_t csum;
+	uint16_t magic;
+};
+
+struct oob_conf {
+	int enabled;
+	int fail_blk;		/* mismatches on blocks stamped in this run fail them */
+	uint32_t seq;		/* stamped on write, expected on read. 0 unknown */
+
+	unsigned int corrupt;
+	unsigned int misdirected;
+	unsigned int stale;
+};
+
+/*
+ * Open-Channel 1.2 completion status with the DNR bit masked off. Anything
+ * else is an NVMe generic status.
+ */
+#define NVM_SC_MASK		0x3fff
+#define NVM_SC_ABORTED		0x0007
+#define NVM_SC_FAILWRITE	0x00ff
+#define NVM_SC_EMPTYPAGE	0x02ff
+#define NVM_SC_FAILECC		0x0281
+#define NVM_SC_FAILCRC		0x0004
+#define NVM_SC_HIGHECC		0x0700
+
+enum io_class {
+	IO_OK = 0,
+	IO_ECC_CORRECTED,	/* data returned, high ECC warning */
+	IO_ECC_UNCORRECTABLE,
+	IO_CRC,
+	IO_EMPTY_PAGE,
+	IO_WRITE_FAULT,
+	IO_ERASE_FAULT,
+	IO_TIMEOUT,		/* also aborts, EINTR, EBUSY: worth a retry */
+	IO_OTHER,
+	IO_NCLASSES,
+};
+
+static const char *io_class_name[IO_NCLASSES] = {
+	"ok", "ecc corrected", "ecc uncorrectable", "crc", "empty page",
+	"write fault", "erase fault", "timeout", "other",
+};
+
+/* Per LUN completion counters, a cache line each to keep workers apart */
+struct io_stats {
+	unsigned int cls[IO_NCLASSES];
+	unsigned int retries;
+	unsigned int recovered;
+} __attribute__((aligned(64)));
+
+/*
+ * Plane x sector layouts with their own per command paths, where the
+ * address list has a fixed size and sector and plane come from constant
+ * shifts. Any other geometry takes the generic path.
+ */
+enum io_layout {
+	IO_LAYOUT_ANY = 0,
+	IO_LAYOUT_1X4,
+	IO_LAYOUT_2X4,
+	IO_LAYOUT_4X4,
+};
+
+struct io_conf {
+	int retries;		/* extra attempts for transient failures */
+	int backoff_us;		/* first retry delay, doubled per attempt */
+	int nluns;
+	int sector_nbytes;
+	struct io_stats *stats;	/* [nchannels][nluns] */
+	struct progress *prog;	/* NULL unless progress is exported */
+	struct prof *prof;	/* NULL unless profiling */
+	int layout;		/* enum io_layout, picked once from the geometry */
+};
+
+/*
+ * Failed sectors per block and pass. A worker owns its LUN for the whole
+ * pass and appends blocks in order, so no locking is needed. Within a block
+ * the bit index is (pg * nplanes + pl) * nsectors + sec.
+ */
+struct fail_blk {
+	uint32_t blk;
+	struct runmap map;
+};
+
+struct fail_lun {
+	struct fail_blk *blks;
+	int nblks;
+	int cap;
+};
+
+struct fail_pass {
+	int op;
+	struct fail_lun *luns;	/* [nchannels][nluns] */
+};
+
+struct fail_map {
+	int nluns;		/* nchannels * nluns */
+	int npasses;
+	struct fail_pass *passes;
+	FILE *export;
+	int ntests;
+};
+
+/*
+ * Data and OOB buffers, one slot of each per worker (ch * nluns + lun), all
+ * carved from one pool so that a large run can sit on huge pages.
+ */
+struct io_bufs {
+	struct bufpool *pool;
+	char *data;
+	char *meta;		/* NULL if the device has no OOB */
+	size_t data_nbytes;	/* per slot */
+	size_t meta_nbytes;
+};
+
+/*
+ * What one run saw of a block, kept only when archiving. Latencies are
+ * summed over passes and averaged when the run is archived.
+ */
+struct blk_result {
+	uint64_t lat_us[3];	/* read, write per page; erase per block */
+	uint16_t nlat[3];
+	uint16_t read_fails;
+	uint8_t flags;		/* ARCHIVE_* */
+};
+
+/*
+ * Adaptive verify. A LUN whose block failure rate is past lun_fail_pct at
+ * 99.99% confidence is declared failed, and from then on is left out or
+ * only sampled. With dev_fail_pct set, the run stops as soon as more than
+ * that share of blocks is certain to fail.
+ *
+ * Each worker walks its LUN in bit reversed order, so the blocks done at
+ * any point spread evenly over it, and takes turns with neighbors of
+ * blocks that just failed, as failures cluster. Rates count a block when
+ * the walk reaches it, so pulled forward neighbors do not skew them.
+ */
+#define ADAPT_MIN_SAMPLE	32
+#define ADAPT_Z			3.72	/* one sided 99.99%, as it is checked over and over */
+#define ADAPT_NEIGHBORS		64
+#define ADAPT_CHECK_EVERY	16	/* blocks between device checks */
+
+/* blk_order.visited */
+#define ADAPT_SEEN		1	/* taken, not a sample */
+#define ADAPT_OK		2
+#define ADAPT_FAIL		3
+
+/* adapt_conf.kept, across passes */
+#define ADAPT_KEPT		1	/* handled by every pass so far */
+#define ADAPT_BAD		2	/* counted in adapt_lun.bad */
+
+struct adapt_lun {
+	int visited;		/* blocks handled this pass, tested or not */
+	int n;			/* reached by the walk, good before this pass */
+	int nfail;		/* of those, failed this pass */
+	int bad;		/* newly failed in any pass of this run */
+	int bad_left;		/* of those, failed before this pass and not tested in it yet */
+	int untested;		/* left out this pass after the LUN failed */
+	int failed;
+	int sampled;		/* failed in an earlier pass, kept blocks are the sample */
+} __attribute__((aligned(64)));
+
+struct adapt_conf {
+	double lun_fail_pct;	/* 0 = off */
+	int downgrade;		/* failed LUN: 0 = stop, N = test every Nth block */
+	double dev_fail_pct;	/* 0 = off */
+	int nluns;
+	int stop;		/* device verdict settled */
+	int stop_op;
+	struct adapt_lun *luns;	/* [nchannels][nluns], NULL unless adaptive */
+	char *kept;		/* [nchannels][nluns][nblocks], ADAPT_KEPT | ADAPT_BAD */
+};
+
+/* one worker's walk over its LUN */
+struct blk_order {
+	int next;		/* cursor, index order unless adaptive */
+	int bits;		/* adaptive: cursor range is 1 << bits */
+	int in_order;		/* last block came from the cursor */
+	int from_pending;	/* last block was a neighbor */
+	int nsampled;		/* cursor blocks seen since the LUN failed */
+	int npending;
+	int pending[ADAPT_NEIGHBORS];
+	char *visited;		/* [nblocks], ADAPT_* */
+	char *kept;		/* [nblocks], this LUN's part of adapt_conf.kept */
+};
 
 struct for_each_conf {
 	int max_ch;
@@ -11,54 +214,410 @@ struct for_each_conf {
 	int show_time;
 	int flag;
 	int dry_run;
-	void *data;
-	void *meta;
+	struct io_bufs bufs;
+	struct oob_conf oob;
+	struct io_conf io;
+	struct fail_map *fails;
+	struct blk_result *results;	/* [nchannels][nluns][nblocks] */
+	struct adapt_conf adapt;
 };
 
-static int rw_blk(struct nvm_dev *dev, const struct nvm_geo *geo, int op, int ch, int lun, int blk, int show_time, void *data, void *meta, int flag)
+static const char *op_name[] = { "read", "write", "erase" };
+
+static struct fail_pass *failmap_pass_begin(struct fail_map *fm, int op)
 {
-	int r = 0;
-	int total = 0;
-	struct timeval t1, t2;
-	double time = 0.0;
+	struct fail_pass *passes;
 
-	if (show_time)
-		gettimeofday(&t1, NULL);
+	passes = realloc(fm->passes, (fm->npasses + 1) * sizeof(*passes));
+	if (!passes)
+		return NULL;
+	fm->passes = passes;
+
+	passes[fm->npasses].op = op;
+	passes[fm->npasses].luns = calloc(fm->nluns, sizeof(struct fail_lun));
+	if (!passes[fm->npasses].luns)
+		return NULL;
+
+	return &passes[fm->npasses++];
+}
+
+/* takes over map; keeps blocks in ascending order, cheap when they come that way */
+static void fail_lun_commit(struct fail_lun *fl, int blk, struct runmap *map)
+{
+	int i;
 
-	for (int pg = 0; pg < geo->npages; pg++) {
-		struct nvm_addr addr[geo->nplanes * geo->nsectors];
-		struct nvm_ret ret;
+	if (!map->nruns) {
+		runmap_free(map);
+		return;
+	}
 
-		for (int i = 0; i < geo->nplanes * geo->nsectors; i++) {
-			addr[i].g.ch = ch;
-			addr[i].g.lun = lun;
-			addr[i].g.pg = pg;
-			addr[i].g.blk = blk;
+	if (fl->nblks == fl->cap) {
+		int cap = fl->cap ? fl->cap * 2 : 4;
+		struct fail_blk *blks = realloc(fl->blks, cap * sizeof(*blks));
 
-			addr[i].g.sec = i % geo->nsectors;
-			addr[i].g.pl = i / geo->nsectors;
+		if (!blks) {
+			runmap_free(map);
+			return;
 		}
+		fl->blks = blks;
+		fl->cap = cap;
+	}
 
-		if (op == 0) {
-			r = nvm_addr_read(dev, addr, geo->nplanes * geo->nsectors, data, meta, flag, &ret);
-		} else {
-			char *vd = data;
-			vd[0] = 0x3;
-			vd[1] = 0x1;
-			vd[2] = 0x3;
-			vd[3] = 0x3;
-			vd[4] = 0x7;
-			r = nvm_addr_write(dev, addr, geo->nplanes * geo->nsectors, data, meta, flag, &ret);
+	for (i = fl->nblks; i && fl->blks[i - 1].blk > blk; i--)
+		;
+	memmove(&fl->blks[i + 1], &fl->blks[i], (fl->nblks - i) * sizeof(*fl->blks));
+	fl->blks[i].blk = blk;
+	fl->blks[i].map = *map;
+	fl->nblks++;
+	*map = (struct runmap)RUNMAP_INIT;
+}
+
+static void failmap_reset(struct fail_map *fm)
+{
+	for (int p = 0; p < fm->npasses; p++) {
+		for (int l = 0; l < fm->nluns; l++) {
+			struct fail_lun *fl = &fm->passes[p].luns[l];
+
+			for (int i = 0; i < fl->nblks; i++)
+				runmap_free(&fl->blks[i].map);
+			free(fl->blks);
+		}
+		free(fm->passes[p].luns);
+	}
+	free(fm->passes);
+	fm->passes = NULL;
+	fm->npasses = 0;
+}
+
+static void *io_data(const struct io_bufs *bufs, int idx)
+{
+	return bufs->data + idx * bufs->data_nbytes;
+}
+
+static void *io_meta(const struct io_bufs *bufs, int idx)
+{
+	return bufs->meta ? bufs->meta + idx * bufs->meta_nbytes : NULL;
+}
+
+static struct blk_result *blk_result(const struct nvm_geo *geo, struct for_each_conf *fec, int ch, int lun, int blk)
+{
+	if (!fec->results)
+		return NULL;
+
+	return &fec->results[(ch * geo->nluns + lun) * geo->nblocks + blk];
+}
+
+static void blk_result_add(const struct nvm_geo *geo, struct for_each_conf *fec, int ch, int lun, int blk, int op,
+			   uint64_t lat_us, int failed)
+{
+	static const uint8_t fail_flag[] = { ARCHIVE_READ_FAIL, ARCHIVE_WRITE_FAIL, ARCHIVE_ERASE_FAIL };
+	struct blk_result *r = blk_result(geo, fec, ch, lun, blk);
+
+	if (!r)
+		return;
+
+	r->lat_us[op] += lat_us;
+	r->nlat[op]++;
+	if (!failed)
+		return;
+
+	r->flags |= fail_flag[op];
+	if (op == 0)
+		r->read_fails += failed;
+}
+
+static enum io_class io_classify(int op, int r, int err, const struct nvm_ret *ret)
+{
+	if (!r)
+		return IO_OK;
+
+	switch (ret->result & NVM_SC_MASK) {
+	case 0x0:
+		break;
+	case NVM_SC_HIGHECC:
+		return IO_ECC_CORRECTED;
+	case NVM_SC_FAILECC:
+		return IO_ECC_UNCORRECTABLE;
+	case NVM_SC_FAILCRC:
+		return IO_CRC;
+	case NVM_SC_EMPTYPAGE:
+		return IO_EMPTY_PAGE;
+	case NVM_SC_FAILWRITE:
+		return op == 2 ? IO_ERASE_FAULT : IO_WRITE_FAULT;
+	case NVM_SC_ABORTED:
+		return IO_TIMEOUT;
+	default:
+		return IO_OTHER;
+	}
+
+	/* no status from the device, the submission itself failed */
+	switch (err) {
+	case ETIMEDOUT:
+	case EINTR:
+	case EAGAIN:
+	case EBUSY:
+		return IO_TIMEOUT;
+	default:
+		return IO_OTHER;
+	}
+}
+
+static int io_failed(enum io_class cls)
+{
+	return cls != IO_OK && cls != IO_ECC_CORRECTED;
+}
+
+/*
+ * Issue one command, retrying transient failures with exponential backoff.
+ * The backoff only holds up the calling worker, i.e. its own LUN.
+ */
+static enum io_class io_submit(struct nvm_dev *dev, const struct io_conf *io, int op, int ch, int lun,
+			       struct nvm_addr *addr, int naddrs, void *data, void *meta, int flag)
+{
+	struct io_stats *st = &io->stats[ch * io->nluns + lun];
+	uint64_t start = io->prog ? progress_now_ns() : 0;
+	int backoff = io->backoff_us;
+	enum io_class cls;
+	int attempt = 0;
+
+	for (;;) {
+		struct nvm_ret ret = { 0 };
+		int r, err;
+
+		switch (op) {
+		case 0:
+			r = nvm_addr_read(dev, addr, naddrs, data, meta, flag, &ret);
+			break;
+		case 1:
+			r = nvm_addr_write(dev, addr, naddrs, data, meta, flag, &ret);
+			break;
+		default:
+			r = nvm_addr_erase(dev, addr, naddrs, flag, &ret);
+			break;
+		}
+		/* the profiler's syscalls may overwrite it */
+		err = errno;
+		prof_lap_io(io->prof, ch * io->nluns + lun);
+
+		cls = io_classify(op, r, err, &ret);
+		if (cls != IO_TIMEOUT || attempt == io->retries)
+			break;
+
+		#pragma omp atomic
+		st->retries++;
+		if (backoff) {
+			usleep(backoff);
+			backoff *= 2;
 		}
+		attempt++;
+	}
+
+	#pragma omp atomic
+	st->cls[cls]++;
+	if (attempt && !io_failed(cls)) {
+		#pragma omp atomic
+		st->recovered++;
+	}
+
+	if (io->prog)
+		progress_cmd(io->prog, ch * io->nluns + lun, op == 2 || io_failed(cls) ? 0 : naddrs * io->sector_nbytes,
+			     io_failed(cls), progress_now_ns() - start);
+
+	return cls;
+}
+
+static uint16_t oob_csum(uint64_t ppa, uint32_t seq)
+{
+	uint64_t x = (ppa ^ ((uint64_t)seq << 32 | seq)) * 0x9e3779b97f4a7c15ULL;
+
+	return (x >> 48) ^ (x >> 32) ^ (x >> 16) ^ x ^ OOB_SIG_MAGIC;
+}
+
+static void oob_stamp(const struct nvm_geo *geo, struct nvm_addr *addr, int naddrs, char *meta, uint32_t seq)
+{
+	for (int i = 0; i < naddrs; i++) {
+		struct oob_sig *sig = (struct oob_sig *)(meta + i * geo->meta_nbytes);
+
+		sig->ppa = addr[i].ppa;
+		sig->seq = seq;
+		sig->csum = oob_csum(addr[i].ppa, seq);
+		sig->magic = OOB_SIG_MAGIC;
+	}
+}
 
-		if (r) {
-			if (ret.result != 0x700)
-				total++;
+/*
+ * Returns the number of sectors whose signature does not match, and adds
+ * them to fails at base + their index when given.
+ */
+static int oob_check(const struct nvm_geo *geo, struct nvm_addr *addr, int naddrs, const char *meta, struct oob_conf *oob,
+		     struct runmap *fails, uint32_t base)
+{
+	int bad = 0;
+
+	for (int i = 0; i < naddrs; i++) {
+		const struct oob_sig *sig = (const struct oob_sig *)(meta + i * geo->meta_nbytes);
+
+		if (sig->magic != OOB_SIG_MAGIC || sig->csum != oob_csum(sig->ppa, sig->seq)) {
+			#pragma omp atomic
+			oob->corrupt++;
+		} else if (sig->ppa != addr[i].ppa) {
+			#pragma omp atomic
+			oob->misdirected++;
+		} else if (oob->seq && sig->seq != oob->seq) {
+			#pragma omp atomic
+			oob->stale++;
+		} else {
+			continue;
 		}
-/*			perror("write failed");
-			nvm_addr_pr(addr[0]);
-			//break;*/
+		if (fails)
+			runmap_add(fails, base + i);
+		bad++;
+	}
+
+	return bad;
+}
+
+/*
+ * OOB signatures need room for one struct oob_sig per sector. The pass
+ * sequence starts somewhere unpredictable so data left by an earlier run
+ * reads back as stale.
+ *
+ * Mismatches are only reported unless fail_blk is set. Even then they only
+ * fail blocks this run wrote: a drive holding other data, or whose OOB
+ * does not round-trip, must not get every block retired by a read pass.
+ */
+static void oob_init(const struct nvm_geo *geo, struct oob_conf *oob, int disable, int fail_blk)
+{
+	memset(oob, 0, sizeof(*oob));
+	oob->fail_blk = fail_blk;
+
+	if (disable)
+		return;
+
+	if (geo->meta_nbytes < sizeof(struct oob_sig)) {
+		printf("OOB area too small for signatures (%zu < %zu bytes). Not verifying OOB.\n",
+				(size_t)geo->meta_nbytes, sizeof(struct oob_sig));
+		return;
+	}
+
+	oob->enabled = 1;
+}
+
+static void oob_next_pass(struct oob_conf *oob)
+{
+	static uint32_t seq;
+
+	if (!seq)
+		seq = time(NULL) ^ (getpid() << 16);
+	if (!++seq)
+		++seq;
+	oob->seq = seq;
+}
+
+static enum io_layout io_layout(const struct nvm_geo *geo)
+{
+	if (geo->nsectors != 4)
+		return IO_LAYOUT_ANY;
+
+	switch (geo->nplanes) {
+	case 1:
+		return IO_LAYOUT_1X4;
+	case 2:
+		return IO_LAYOUT_2X4;
+	case 4:
+		return IO_LAYOUT_4X4;
+	default:
+		return IO_LAYOUT_ANY;
+	}
+}
+
+/* Body of rw_pg, inlined once per layout so nplanes and nsectors are constants */
+static inline __attribute__((always_inline)) int rw_pg_layout(struct nvm_dev *dev, const struct nvm_geo *geo, int op, int ch, int lun,
+							      int blk, int pg, void *data, void *meta, int flag, struct oob_conf *oob,
+							      const struct io_conf *io, struct runmap *fails,
+							      const int nplanes, const int nsectors)
+{
+	const int naddrs = nplanes * nsectors;
+	struct nvm_addr addr[naddrs];
+	struct nvm_addr base;
+	enum io_class cls;
+	int bad;
+
+	prof_lap(io->prof, ch * io->nluns + lun, PROF_BOOK);
+
+	base.ppa = 0;
+	base.g.ch = ch;
+	base.g.lun = lun;
+	base.g.pg = pg;
+	base.g.blk = blk;
+
+	for (int i = 0; i < naddrs; i++) {
+		addr[i].ppa = base.ppa;
+		addr[i].g.sec = i % nsectors;
+		addr[i].g.pl = i / nsectors;
+	}
+
+	prof_lap(io->prof, ch * io->nluns + lun, PROF_ADDR);
+
+	if (op == 1) {
+		char *vd = data;
+		vd[0] = 0x3;
+		vd[1] = 0x1;
+		vd[2] = 0x3;
+		vd[3] = 0x3;
+		vd[4] = 0x7;
+		if (oob->enabled)
+			oob_stamp(geo, addr, naddrs, meta, oob->seq);
+		prof_lap(io->prof, ch * io->nluns + lun, PROF_PATTERN);
+	}
+
+	cls = io_submit(dev, io, op, ch, lun, addr, naddrs, data, meta, flag);
+	if (io_failed(cls)) {
+		if (fails)
+			runmap_add_range(fails, pg * naddrs, naddrs);
+		return 1;
+	}
+
+	if (op == 0 && oob->enabled) {
+		prof_lap(io->prof, ch * io->nluns + lun, PROF_BOOK);
+		bad = oob_check(geo, addr, naddrs, meta, oob, oob->fail_blk && oob->seq ? fails : NULL, pg * naddrs);
+		prof_lap(io->prof, ch * io->nluns + lun, PROF_VERIFY);
+		if (bad && oob->fail_blk && oob->seq)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Read or write one page over all planes and sectors. Returns 1 if it failed. */
+static int rw_pg(struct nvm_dev *dev, const struct nvm_geo *geo, int op, int ch, int lun, int blk, int pg, void *data, void *meta, int flag,
+		 struct oob_conf *oob, const struct io_conf *io, struct runmap *fails)
+{
+	switch (io->layout) {
+	case IO_LAYOUT_1X4:
+		return rw_pg_layout(dev, geo, op, ch, lun, blk, pg, data, meta, flag, oob, io, fails, 1, 4);
+	case IO_LAYOUT_2X4:
+		return rw_pg_layout(dev, geo, op, ch, lun, blk, pg, data, meta, flag, oob, io, fails, 2, 4);
+	case IO_LAYOUT_4X4:
+		return rw_pg_layout(dev, geo, op, ch, lun, blk, pg, data, meta, flag, oob, io, fails, 4, 4);
+	default:
+		return rw_pg_layout(dev, geo, op, ch, lun, blk, pg, data, meta, flag, oob, io, fails,
+				    geo->nplanes, geo->nsectors);
 	}
+}
+
+static int rw_blk(struct nvm_dev *dev, const struct nvm_geo *geo, int op, int ch, int lun, int blk, int show_time, void *data, void *meta, int flag,
+		  struct oob_conf *oob, const struct io_conf *io, struct runmap *fails)
+{
+	int total = 0;
+	struct timeval t1, t2;
+	double time = 0.0;
+
+	if (show_time)
+		gettimeofday(&t1, NULL);
+
+	for (int pg = 0; pg < geo->npages; pg++)
+		total += rw_pg(dev, geo, op, ch, lun, blk, pg, data, meta, flag, oob, io, fails);
 
 	if (show_time) {
 		gettimeofday(&t2, NULL);
@@ -71,15 +630,18 @@ static int rw_blk(struct nvm_dev *dev, const struct nvm_geo *geo, int op, int ch
 	return total;
 }
 
-static int erase_blk(struct nvm_dev *dev, const struct nvm_geo *geo, int ch, int lun, int blk, int show_time, int flag)
+static inline __attribute__((always_inline)) int erase_blk_layout(struct nvm_dev *dev, const struct nvm_geo *geo, int ch, int lun,
+								  int blk, int show_time, int flag, const struct io_conf *io,
+								  const int nplanes)
 {
-	struct nvm_addr addr[geo->nplanes];
-	struct nvm_ret ret;
+	struct nvm_addr addr[nplanes];
 	struct timeval t1, t2;
 	double time = 0.0;
-	int r;
+	enum io_class cls;
 
-	for (int pl = 0; pl < geo->nplanes; pl++) {
+	prof_lap(io->prof, ch * io->nluns + lun, PROF_BOOK);
+
+	for (int pl = 0; pl < nplanes; pl++) {
 		addr[pl].ppa = 0;
 		addr[pl].g.ch = ch;
 		addr[pl].g.lun = lun;
@@ -87,15 +649,12 @@ static int erase_blk(struct nvm_dev *dev, const struct nvm_geo *geo, int ch, int
 		addr[pl].g.pl = pl;
 	}
 
+	prof_lap(io->prof, ch * io->nluns + lun, PROF_ADDR);
+
 	if (show_time)
 		gettimeofday(&t1, NULL);
 
-	r = nvm_addr_erase(dev, addr, geo->nplanes, flag, &ret);
-	if (r) {
-/*		perror("erase failed");
-		nvm_ret_pr(&ret);
-		nvm_addr_pr(addr[0]);*/
-	}
+	cls = io_submit(dev, io, 2, ch, lun, addr, nplanes, NULL, NULL, flag);
 
 	if (show_time) {
 		gettimeofday(&t2, NULL);
@@ -105,153 +664,1681 @@ static int erase_blk(struct nvm_dev *dev, const struct nvm_geo *geo, int ch, int
 		printf("(%02u,%02u,%03u): avg.time: %f ms\n", ch, lun, blk, time);
 	}
 
-	return r;
+	return io_failed(cls);
 }
 
-static int for_each_blk(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, int report[geo->nchannels][geo->nluns][geo->nblocks])
+static int erase_blk(struct nvm_dev *dev, const struct nvm_geo *geo, int ch, int lun, int blk, int show_time, int flag,
+		     const struct io_conf *io)
 {
-	int ret;
+	switch (io->layout) {
+	case IO_LAYOUT_1X4:
+		return erase_blk_layout(dev, geo, ch, lun, blk, show_time, flag, io, 1);
+	case IO_LAYOUT_2X4:
+		return erase_blk_layout(dev, geo, ch, lun, blk, show_time, flag, io, 2);
+	case IO_LAYOUT_4X4:
+		return erase_blk_layout(dev, geo, ch, lun, blk, show_time, flag, io, 4);
+	default:
+		return erase_blk_layout(dev, geo, ch, lun, blk, show_time, flag, io, geo->nplanes);
+	}
+}
+
+/* a block is bad if any of its planes is; 4 planes are one 32 bit load */
+static int blk_is_bad(const struct nvm_geo *geo, const struct io_conf *io, const struct nvm_bbt *bbt, int blk)
+{
+	const uint8_t *b = bbt->blks;
+	uint32_t v;
+
+	switch (io->layout) {
+	case IO_LAYOUT_1X4:
+		return b[blk] != 0;
+	case IO_LAYOUT_2X4:
+		return (b[blk * 2] | b[blk * 2 + 1]) != 0;
+	case IO_LAYOUT_4X4:
+		memcpy(&v, &b[blk * 4], sizeof(v));
+		return v != 0;
+	default:
+		for (int pl = 0; pl < geo->nplanes; pl++)
+			if (b[(blk * geo->nplanes) + pl])
+				return 1;
+		return 0;
+	}
+}
+
+static void mark_blk_bad(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, int ch, int lun, int blk,
+			 int report[geo->nchannels][geo->nluns][geo->nblocks])
+{
+	struct nvm_addr addr[geo->nplanes];
+
+	for (int pl = 0; pl < geo->nplanes; pl++) {
+		addr[pl].ppa = 0;
+		addr[pl].g.ch = ch;
+		addr[pl].g.lun = lun;
+		addr[pl].g.blk = blk;
+		addr[pl].g.pl = pl;
+	}
+	if (fec->dry_run) {
+		printf("(%02u,%02u,%03u): marked bad (dry_run)\n", ch, lun, blk);
+	}
+	else {
+		#pragma omp critical(BBT_ACCESS)
+		{
+			nvm_bbt_mark(dev, addr, geo->nplanes, 0x2, NULL);
+			printf("(%02u,%02u,%03u): marked bad\n", ch, lun, blk);
+		}
+	}
+	report[ch][lun][blk] = 0x1000000;
+	if (fec->results)
+		blk_result(geo, fec, ch, lun, blk)->flags |= ARCHIVE_MARKED_BAD;
+}
+
+/* lower end of the Wilson score interval for k failures in n */
+static double wilson_lo(int k, int n)
+{
+	const double z2 = ADAPT_Z * ADAPT_Z;
+	double p, c;
+
+	if (!n)
+		return 0.0;
+
+	p = (double)k / n;
+	c = p + z2 / (2 * n) - ADAPT_Z * sqrt(p * (1 - p) / n + z2 / (4.0 * n * n));
+
+	return c > 0 ? c / (1 + z2 / n) : 0.0;
+}
+
+/* LUN counters are only written by their worker, but read by all for the device verdict */
+static int adapt_get(const int *v)
+{
+	return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+static void adapt_inc(int *v)
+{
+	__atomic_store_n(v, *v + 1, __ATOMIC_RELAXED);
+}
+
+static void adapt_pass_begin(struct for_each_conf *fec)
+{
+	struct adapt_conf *ad = &fec->adapt;
+
+	if (!ad->luns)
+		return;
+
+	for (int i = 0; i < fec->max_ch * ad->nluns; i++) {
+		ad->luns[i].visited = 0;
+		ad->luns[i].n = 0;
+		ad->luns[i].nfail = 0;
+		ad->luns[i].untested = 0;
+		ad->luns[i].sampled = ad->luns[i].failed;
+		ad->luns[i].bad_left = ad->luns[i].bad;
+	}
+}
+
+/*
+ * Blocks of a LUN that this pass has not tested and that have not failed in
+ * an earlier one, so are counted once next to adapt_lun.bad
+ */
+static int adapt_unknown(const struct for_each_conf *fec, const struct adapt_lun *al)
+{
+	const int per = fec->max_blk - fec->skip_blk;
+
+	return adapt_get(&al->untested) + per - adapt_get(&al->visited) - adapt_get(&al->bad_left);
+}
+
+/*
+ * True once the device will end up with more than dev_fail_pct of its
+ * blocks failed whatever the rest shows: the blocks failed so far, all
+ * blocks left out on failed LUNs, and the untested rest failing at no less
+ * than the lower bound of the rate seen so far.
+ */
+static int adapt_settled(const struct for_each_conf *fec)
+{
+	const struct adapt_conf *ad = &fec->adapt;
+	const int per = fec->max_blk - fec->skip_blk;
+	uint64_t failed = 0, unknown = 0;
+	int n = 0, k = 0;
+	double lo;
+
+	if (per <= 0)
+		return 0;
 
-#pragma omp parallel for collapse (2) schedule (static)
 	for (int ch = 0; ch < fec->max_ch; ch++) {
 		for (int lun = 0; lun < fec->max_lun; lun++) {
-			struct nvm_bbt* bbt;
-			struct nvm_ret bbt_ret;
-			struct nvm_addr bbt_addr;
-
-			bbt_addr.ppa = 0;
-			bbt_addr.g.ch = ch;
-			bbt_addr.g.lun = lun;
+			const struct adapt_lun *al = &ad->luns[ch * ad->nluns + lun];
+			int left = adapt_unknown(fec, al);
 
-			#pragma omp critical(BBT_ACCESS)
-			{
-				bbt = nvm_bbt_alloc_cp(nvm_bbt_get(dev, bbt_addr, &bbt_ret));
-			}
-			if (!bbt) {
-				perror("Could not retrieve bad block table");
-				nvm_ret_pr(&bbt_ret);
+			failed += adapt_get(&al->bad);
+			if (adapt_get(&al->failed)) {
+				failed += left;
 				continue;
 			}
+			unknown += left;
+			n += adapt_get(&al->n);
+			k += adapt_get(&al->nfail);
+		}
+	}
 
-			for (int blk = fec->skip_blk; blk < fec->max_blk; blk++) {
-				int skip = 0;
-				/* bad block check */
-				for (int pl = 0; pl < geo->nplanes; pl++) {
-					if (bbt->blks[(blk * geo->nplanes) + pl]) {
-						printf("(%02u,%02u,%03u): skip\n", ch, lun, blk);
-						skip = 1;
-						report[ch][lun][blk] = 0x100000;
-						break;
-					}
-				}
+	lo = n >= ADAPT_MIN_SAMPLE ? wilson_lo(k, n) : 0.0;
 
-				if (skip)
-					continue;
+	return (failed + lo * unknown) * 100.0 > ad->dev_fail_pct * fec->max_ch * fec->max_lun * per;
+}
 
-				switch (fec->op) {
-				case 0:
-					ret = rw_blk(dev, geo, fec->op, ch, lun, blk, fec->show_time, fec->data, fec->meta, fec->flag);
-					if (ret)
-						report[ch][lun][blk] += ret;
-					break;
-				case 1:
-					ret = rw_blk(dev, geo, fec->op, ch, lun, blk, fec->show_time, fec->data, fec->meta, fec->flag);
-					if (ret)
-						report[ch][lun][blk] = 0x1000;
-					break;
-				case 2:
-					ret = erase_blk(dev, geo, ch, lun, blk, fec->show_time, fec->flag);
-					if (ret)
-						report[ch][lun][blk] = 0x10000;
-					break;
-				}
+static void adapt_count(struct for_each_conf *fec, int slot, struct adapt_lun *al, struct blk_order *ord, int failed)
+{
+	const struct adapt_conf *ad = &fec->adapt;
 
-				if (report[ch][lun][blk]) {
-					struct nvm_addr addr[geo->nplanes];
+	adapt_inc(&al->n);
+	if (failed)
+		adapt_inc(&al->nfail);
 
-					for (int pl = 0; pl < geo->nplanes; pl++) {
-						addr[pl].ppa = 0;
-						addr[pl].g.ch = ch;
-						addr[pl].g.lun = lun;
-						addr[pl].g.blk = blk;
-						addr[pl].g.pl = pl;
-					}
-					if (fec->dry_run) {
-						printf("(%02u,%02u,%03u): marked bad (dry_run)\n", ch, lun, blk);
-					}
-					else {
-						#pragma omp critical(BBT_ACCESS)
-						{
-							nvm_bbt_mark(dev, addr, geo->nplanes, 0x2, NULL);
-							printf("(%02u,%02u,%03u): marked bad\n", ch, lun, blk);
-						}
-					}
-					report[ch][lun][blk] = 0x1000000;
-				}
-			}
+	if (!ad->lun_fail_pct || al->failed || al->n < ADAPT_MIN_SAMPLE ||
+	    wilson_lo(al->nfail, al->n) * 100.0 <= ad->lun_fail_pct)
+		return;
 
-			nvm_bbt_free(bbt);
-		}
+	__atomic_store_n(&al->failed, 1, __ATOMIC_RELAXED);
+	ord->npending = 0;
+	printf("(%02u,%02u): LUN failed, %d of %d blocks failed in %s, %s\n", slot / ad->nluns, slot % ad->nluns,
+	       al->nfail, al->n, op_name[fec->op], ad->downgrade ? "sampling the rest" : "leaving the rest untested");
+}
+
+/* next cursor block in bit reversed order, -1 at the end */
+static int adapt_walk(struct blk_order *ord, int skip, int per)
+{
+	if (per <= 0)
+		return -1;
+
+	while (ord->next < 1 << ord->bits) {
+		unsigned int i = ord->next++, r = 0;
+
+		for (int b = 0; b < ord->bits; b++, i >>= 1)
+			r = r << 1 | (i & 1);
+		if (r < (unsigned int)per)
+			return skip + r;
+	}
+
+	return -1;
+}
+
+static int adapt_take(struct adapt_lun *al, struct blk_order *ord, int blk, int in_order)
+{
+	if (ord->kept[blk] & ADAPT_BAD)
+		__atomic_store_n(&al->bad_left, al->bad_left - 1, __ATOMIC_RELAXED);
+	ord->visited[blk] = ADAPT_SEEN;
+	ord->in_order = in_order;
+	adapt_inc(&al->visited);
+
+	return blk;
+}
+
+/*
+ * Leave blk out of this pass and so of every later one: each pass must
+ * only touch blocks the passes before it handled, or programs hit blocks
+ * that were never erased and reads blocks that were never written.
+ */
+static void adapt_leave(struct for_each_conf *fec, int slot, struct adapt_lun *al, struct blk_order *ord, int blk)
+{
+	ord->visited[blk] = ADAPT_SEEN;
+	ord->kept[blk] = 0;
+	adapt_inc(&al->visited);
+	adapt_inc(&al->untested);
+	progress_blk(fec->io.prog, slot);
+}
+
+/* Next block for this LUN's worker, -1 when done */
+static int adapt_next(struct for_each_conf *fec, int slot, struct adapt_lun *al, struct blk_order *ord)
+{
+	const struct adapt_conf *ad = &fec->adapt;
+	const int per = fec->max_blk - fec->skip_blk;
+
+	/* no walk state: index order, still only over blocks earlier passes handled */
+	if (!al) {
+		while (ord->next < fec->max_blk && ord->kept && !ord->kept[ord->next])
+			ord->next++;
+		return ord->next < fec->max_blk ? ord->next++ : -1;
 	}
 
-	return 0;
+	if (adapt_get(&ad->stop))
+		return -1;
+
+	for (;;) {
+		int blk;
+
+		/* neighbors take turns with the walk */
+		if (ord->npending && !ord->from_pending) {
+			blk = ord->pending[--ord->npending];
+			if (ord->visited[blk])
+				continue;
+			ord->from_pending = 1;
+			return adapt_take(al, ord, blk, 0);
+		}
+		ord->from_pending = 0;
+
+		blk = adapt_walk(ord, fec->skip_blk, per);
+		if (blk < 0)
+			return -1;
+
+		switch (ord->visited[blk]) {
+		case ADAPT_OK:
+		case ADAPT_FAIL:
+			adapt_count(fec, slot, al, ord, ord->visited[blk] == ADAPT_FAIL);
+			continue;
+		case ADAPT_SEEN:
+			continue;
+		}
+
+		/* the sample is picked once, in the pass the LUN failed in */
+		if (!ord->kept[blk] ||
+		    (al->failed && !al->sampled && (!ad->downgrade || ord->nsampled++ % ad->downgrade))) {
+			adapt_leave(fec, slot, al, ord, blk);
+			continue;
+		}
+
+		return adapt_take(al, ord, blk, 1);
+	}
+}
+
+/* Account for a tested block; was_ok if it had not failed in an earlier pass */
+static void adapt_done(struct for_each_conf *fec, int slot, struct adapt_lun *al, struct blk_order *ord,
+		       int blk, int was_ok, int failed)
+{
+	struct adapt_conf *ad = &fec->adapt;
+
+	if (!al || !was_ok)
+		return;
+
+	ord->visited[blk] = failed ? ADAPT_FAIL : ADAPT_OK;
+
+	if (failed) {
+		ord->kept[blk] |= ADAPT_BAD;
+		adapt_inc(&al->bad);
+
+		for (int d = -1; d <= 1 && !al->failed; d += 2) {
+			int nb = blk + d;
+
+			if (nb >= fec->skip_blk && nb < fec->max_blk && !ord->visited[nb] && ord->kept[nb] &&
+			    ord->npending < ADAPT_NEIGHBORS)
+				ord->pending[ord->npending++] = nb;
+		}
+	}
+
+	if (ord->in_order)
+		adapt_count(fec, slot, al, ord, failed);
+
+	if (!ad->dev_fail_pct || (!failed && al->visited % ADAPT_CHECK_EVERY) || !adapt_settled(fec))
+		return;
+
+	#pragma omp critical(ADAPT)
+	{
+		if (!ad->stop) {
+			ad->stop_op = fec->op;
+			__atomic_store_n(&ad->stop, 1, __ATOMIC_RELAXED);
+			printf("Device failed: more than %.1f%% of blocks will fail, stopping\n", ad->dev_fail_pct);
+		}
+	}
+}
+
+/* one line per pass: where worker time went since before */
+static void print_prof_pass(const struct prof *prof, const char *name, const struct prof_stat before[PROF_NPHASES])
+{
+	struct prof_stat now[PROF_NPHASES];
+	uint64_t wall[PROF_NPHASES], total = 0;
+
+	if (!prof)
+		return;
+
+	prof_total(prof, now);
+	for (int ph = 0; ph < PROF_NPHASES; ph++) {
+		wall[ph] = now[ph].wall_ns - before[ph].wall_ns;
+		total += wall[ph];
+	}
+	if (!total)
+		return;
+
+	printf("  %-6s:", name);
+	for (int ph = 0; ph < PROF_NPHASES; ph++)
+		printf(" %s %.1f%%%s", prof_phase_name(ph), 100.0 * wall[ph] / total, ph + 1 < PROF_NPHASES ? "," : "\n");
+}
+
+static int for_each_blk(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, int report[geo->nchannels][geo->nluns][geo->nblocks])
+{
+	struct fail_pass *pass = NULL;
+	struct prof_stat before[PROF_NPHASES];
+
+	if (fec->fails) {
+		pass = failmap_pass_begin(fec->fails, fec->op);
+		if (!pass)
+			printf("Could not allocate failure map. Not tracking sectors.\n");
+	}
+
+	progress_pass_begin(fec->io.prog, fec->op, (uint64_t)fec->max_ch * fec->max_lun * (fec->max_blk - fec->skip_blk));
+	prof_total(fec->io.prof, before);
+	adapt_pass_begin(fec);
+
+	/* a thread per LUN, so a retry backing off stalls no other LUN */
+#pragma omp parallel for collapse (2) schedule (static) num_threads(fec->max_ch * fec->max_lun)
+	for (int ch = 0; ch < fec->max_ch; ch++) {
+		for (int lun = 0; lun < fec->max_lun; lun++) {
+			struct nvm_bbt* bbt;
+			struct nvm_ret bbt_ret;
+			struct nvm_addr bbt_addr;
+			struct fail_lun *fl = pass ? &pass->luns[ch * geo->nluns + lun] : NULL;
+			void *data = io_data(&fec->bufs, ch * geo->nluns + lun);
+			void *meta = io_meta(&fec->bufs, ch * geo->nluns + lun);
+			struct adapt_lun *al = fec->adapt.luns ? &fec->adapt.luns[ch * geo->nluns + lun] : NULL;
+			struct blk_order ord = { .next = al ? 0 : fec->skip_blk };
+			int blk;
+
+			prof_start(fec->io.prof);
+
+			bbt_addr.ppa = 0;
+			bbt_addr.g.ch = ch;
+			bbt_addr.g.lun = lun;
+
+			#pragma omp critical(BBT_ACCESS)
+			{
+				bbt = nvm_bbt_alloc_cp(nvm_bbt_get(dev, bbt_addr, &bbt_ret));
+			}
+			if (!bbt) {
+				perror("Could not retrieve bad block table");
+				nvm_ret_pr(&bbt_ret);
+				continue;
+			}
+			if (al) {
+				while (1 << ord.bits < fec->max_blk - fec->skip_blk)
+					ord.bits++;
+				ord.visited = calloc(fec->max_blk, 1);
+				ord.kept = fec->adapt.kept + (size_t)(ch * geo->nluns + lun) * geo->nblocks;
+				if (!ord.visited) {
+					al = NULL;
+					ord.next = fec->skip_blk;
+				}
+			}
+
+			while ((blk = adapt_next(fec, ch * geo->nluns + lun, al, &ord)) >= 0) {
+				struct runmap fails = RUNMAP_INIT;
+				int was_ok = !report[ch][lun][blk];
+				uint64_t t = 0;
+				int ret = 0;
+
+				progress_blk(fec->io.prog, ch * geo->nluns + lun);
+
+				if (blk_is_bad(geo, &fec->io, bbt, blk)) {
+					printf("(%02u,%02u,%03u): skip\n", ch, lun, blk);
+					report[ch][lun][blk] = 0x100000;
+					if (fec->results)
+						blk_result(geo, fec, ch, lun, blk)->flags |= ARCHIVE_SKIPPED;
+					continue;
+				}
+
+				if (fec->results)
+					t = progress_now_ns();
+
+				switch (fec->op) {
+				case 0:
+					ret = rw_blk(dev, geo, fec->op, ch, lun, blk, fec->show_time, data, meta, fec->flag, &fec->oob, &fec->io,
+						     fl ? &fails : NULL);
+					if (ret)
+						report[ch][lun][blk] += ret;
+					break;
+				case 1:
+					ret = rw_blk(dev, geo, fec->op, ch, lun, blk, fec->show_time, data, meta, fec->flag, &fec->oob, &fec->io,
+						     fl ? &fails : NULL);
+					if (ret)
+						report[ch][lun][blk] = 0x1000;
+					break;
+				case 2:
+					ret = erase_blk(dev, geo, ch, lun, blk, fec->show_time, fec->flag, &fec->io);
+					if (ret) {
+						report[ch][lun][blk] = 0x10000;
+						if (fl)
+							runmap_add_range(&fails, 0, geo->npages * geo->nplanes * geo->nsectors);
+					}
+					break;
+				}
+
+				if (fec->results)
+					blk_result_add(geo, fec, ch, lun, blk, fec->op,
+						       (progress_now_ns() - t) / 1000 / (fec->op == 2 ? 1 : geo->npages), ret);
+
+				if (fl)
+					fail_lun_commit(fl, blk, &fails);
+
+				if (report[ch][lun][blk])
+					mark_blk_bad(dev, geo, fec, ch, lun, blk, report);
+
+				adapt_done(fec, ch * geo->nluns + lun, al, &ord, blk, was_ok, ret);
+			}
+
+			free(ord.visited);
+			nvm_bbt_free(bbt);
+			prof_lap(fec->io.prof, ch * geo->nluns + lun, PROF_BOOK);
+		}
+	}
+
+	print_prof_pass(fec->io.prof, op_name[fec->op], before);
+
+	return 0;
+}
+
+/*
+ * Line mode. A line is the same block index on every LUN, the unit pblk
+ * allocates and writes. Pages are striped over the LUNs the way pblk lays
+ * out a line: page 0 on every LUN, then page 1 on every LUN, and so on,
+ * with channels varying fastest. Each LUN gets its own thread so the whole
+ * line is in flight at once. LUNs sync up every LINE_SYNC_PGS pages, which
+ * bounds how far one can run ahead of the stripe, like pblk's write buffer
+ * does, without paying for a barrier on every page.
+ */
+#define LINE_SYNC_PGS 16
+
+struct line_stats {
+	int nluns;
+	unsigned int ncmds;
+	unsigned int nfailed;
+	double bytes;
+	double time_ms;
+	double lat_avg_us;
+	double lat_p99_us;
+	double lat_max_us;
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void line_op(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, int op, int blk,
+		    int *bad, int *failed, struct runmap *fails, double *lat, struct line_stats *ls)
+{
+	const int nlun = fec->max_ch * fec->max_lun;
+	const int npages = op == 2 ? 1 : geo->npages;
+	double t;
+
+	memset(ls, 0, sizeof(*ls));
+	t = now_us();
+
+#pragma omp parallel num_threads(nlun)
+	{
+		const int tid = omp_get_thread_num();
+		const int nthreads = omp_get_num_threads();
+		void *data = io_data(&fec->bufs, tid);
+		void *meta = io_meta(&fec->bufs, tid);
+
+		prof_start(fec->io.prof);
+
+		for (int pg = 0; pg < npages; pg++) {
+			for (int idx = tid; idx < nlun; idx += nthreads) {
+				int ch = idx % fec->max_ch;
+				int lun = idx / fec->max_ch;
+				double c = now_us();
+
+				if (bad[idx])
+					continue;
+
+				if (op == 2)
+					failed[idx] += erase_blk(dev, geo, ch, lun, blk, 0, fec->flag, &fec->io);
+				else
+					failed[idx] += rw_pg(dev, geo, op, ch, lun, blk, pg, data, meta, fec->flag, &fec->oob, &fec->io,
+							     fails ? &fails[idx] : NULL);
+
+				lat[idx * npages + pg] = now_us() - c;
+			}
+			if ((pg + 1) % LINE_SYNC_PGS == 0) {
+				#pragma omp barrier
+			}
+		}
+
+		prof_lap(fec->io.prof, (tid % fec->max_ch) * geo->nluns + tid / fec->max_ch, PROF_BOOK);
+	}
+
+	ls->time_ms = (now_us() - t) / 1000.0;
+
+	for (int idx = 0; idx < nlun; idx++) {
+		double lun_us = 0.0;
+
+		if (bad[idx])
+			continue;
+		for (int pg = 0; pg < npages; pg++) {
+			double l = lat[idx * npages + pg];
+
+			lat[ls->ncmds++] = l;
+			lun_us += l;
+		}
+		ls->lat_avg_us += lun_us;
+		blk_result_add(geo, fec, idx % fec->max_ch, idx / fec->max_ch, blk, op, lun_us / npages, failed[idx]);
+		ls->nluns++;
+		ls->nfailed += failed[idx];
+	}
+
+	if (!ls->ncmds)
+		return;
+
+	if (op != 2)
+		ls->bytes = (double)ls->ncmds * geo->nplanes * geo->nsectors * geo->sector_nbytes;
+	ls->lat_avg_us /= ls->ncmds;
+	qsort(lat, ls->ncmds, sizeof(double), cmp_double);
+	ls->lat_p99_us = lat[(ls->ncmds * 99) / 100];
+	ls->lat_max_us = lat[ls->ncmds - 1];
+}
+
+static void print_line_stats(int blk, int op, const struct line_stats *ls)
+{
+	printf("[LINE %04u] %-5s: luns %03d cmds %06u failed %05u time %9.3f ms bw %8.1f MB/s lat avg %8.1f p99 %8.1f max %8.1f us\n",
+			blk, op_name[op], ls->nluns, ls->ncmds, ls->nfailed, ls->time_ms,
+			ls->time_ms ? ls->bytes / (ls->time_ms * 1000.0) : 0.0,
+			ls->lat_avg_us, ls->lat_p99_us, ls->lat_max_us);
+}
+
+/* ops is a mask of (1 << op), run erase, write, read in that order per line */
+static int for_each_line(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, int ops,
+			 int report[geo->nchannels][geo->nluns][geo->nblocks])
+{
+	const int nlun = fec->max_ch * fec->max_lun;
+	struct nvm_bbt *bbts[nlun];
+	int pass[3] = { -1, -1, -1 };	/* index, passes move on realloc */
+	struct line_stats sum[3];
+	struct prof_stat before[PROF_NPHASES];
+	double *lat;
+
+	lat = malloc(nlun * geo->npages * sizeof(double));
+	if (!lat)
+		return -ENOMEM;
+
+	for (int idx = 0; idx < nlun; idx++) {
+		struct nvm_ret bbt_ret;
+		struct nvm_addr bbt_addr;
+
+		bbt_addr.ppa = 0;
+		bbt_addr.g.ch = idx % fec->max_ch;
+		bbt_addr.g.lun = idx / fec->max_ch;
+
+		bbts[idx] = nvm_bbt_alloc_cp(nvm_bbt_get(dev, bbt_addr, &bbt_ret));
+		if (!bbts[idx]) {
+			perror("Could not retrieve bad block table");
+			nvm_ret_pr(&bbt_ret);
+		}
+	}
+
+	for (int op = 2; op >= 0; op--)
+		if ((ops & (1 << op)) && fec->fails && failmap_pass_begin(fec->fails, op))
+			pass[op] = fec->fails->npasses - 1;
+
+	memset(sum, 0, sizeof(sum));
+	prof_total(fec->io.prof, before);
+	progress_pass_begin(fec->io.prog, PROGRESS_OP_LINE,
+			    (uint64_t)nlun * (fec->max_blk - fec->skip_blk) * __builtin_popcount(ops));
+
+	for (int blk = fec->skip_blk; blk < fec->max_blk; blk++) {
+		int bad[nlun];
+
+		for (int idx = 0; idx < nlun; idx++) {
+			int ch = idx % fec->max_ch;
+			int lun = idx / fec->max_ch;
+
+			bad[idx] = !bbts[idx] || blk_is_bad(geo, &fec->io, bbts[idx], blk);
+			if (bad[idx] && bbts[idx]) {
+				printf("(%02u,%02u,%03u): skip\n", ch, lun, blk);
+				report[ch][lun][blk] = 0x100000;
+				if (fec->results)
+					blk_result(geo, fec, ch, lun, blk)->flags |= ARCHIVE_SKIPPED;
+			}
+		}
+
+		for (int op = 2; op >= 0; op--) {
+			struct runmap fails[nlun];
+			int failed[nlun];
+			struct line_stats ls;
+
+			if (!(ops & (1 << op)))
+				continue;
+
+			memset(failed, 0, sizeof(failed));
+			for (int idx = 0; idx < nlun; idx++)
+				fails[idx] = (struct runmap)RUNMAP_INIT;
+
+			if (op == 1)
+				oob_next_pass(&fec->oob);
+
+			line_op(dev, geo, fec, op, blk, bad, failed, pass[op] >= 0 ? fails : NULL, lat, &ls);
+			print_line_stats(blk, op, &ls);
+
+			sum[op].ncmds += ls.ncmds;
+			sum[op].nfailed += ls.nfailed;
+			sum[op].bytes += ls.bytes;
+			sum[op].time_ms += ls.time_ms;
+			sum[op].lat_avg_us += ls.lat_avg_us * ls.ncmds;
+			if (ls.lat_p99_us > sum[op].lat_p99_us)
+				sum[op].lat_p99_us = ls.lat_p99_us;
+			if (ls.lat_max_us > sum[op].lat_max_us)
+				sum[op].lat_max_us = ls.lat_max_us;
+
+			for (int idx = 0; idx < nlun; idx++) {
+				int ch = idx % fec->max_ch;
+				int lun = idx / fec->max_ch;
+
+				progress_blk(fec->io.prog, ch * geo->nluns + lun);
+
+				if (pass[op] >= 0) {
+					struct fail_pass *fp = &fec->fails->passes[pass[op]];
+
+					if (op == 2 && failed[idx])
+						runmap_add_range(&fails[idx], 0, geo->npages * geo->nplanes * geo->nsectors);
+					fail_lun_commit(&fp->luns[ch * geo->nluns + lun], blk, &fails[idx]);
+				}
+
+				if (bad[idx] || !failed[idx])
+					continue;
+
+				if (op == 0)
+					report[ch][lun][blk] += failed[idx];
+				else
+					report[ch][lun][blk] = op == 1 ? 0x1000 : 0x10000;
+
+				mark_blk_bad(dev, geo, fec, ch, lun, blk, report);
+				/* rest of the line goes on without it, as pblk would */
+				bad[idx] = 1;
+			}
+		}
+	}
+
+	printf("\nLine totals:\n");
+	for (int op = 2; op >= 0; op--) {
+		if (!(ops & (1 << op)) || !sum[op].ncmds)
+			continue;
+		sum[op].lat_avg_us /= sum[op].ncmds;
+		printf("%-5s: cmds %08u failed %06u time %10.3f ms bw %8.1f MB/s lat avg %8.1f p99(max line) %8.1f max %8.1f us\n",
+				op_name[op], sum[op].ncmds, sum[op].nfailed, sum[op].time_ms,
+				sum[op].time_ms ? sum[op].bytes / (sum[op].time_ms * 1000.0) : 0.0,
+				sum[op].lat_avg_us, sum[op].lat_p99_us, sum[op].lat_max_us);
+	}
+
+	print_prof_pass(fec->io.prof, "line", before);
+
+	for (int idx = 0; idx < nlun; idx++)
+		nvm_bbt_free(bbts[idx]);
+	free(lat);
+
+	return 0;
+}
+
+/*
+ * Mixed workload. Reads run against some LUNs while programs and erases
+ * keep others busy, and every read is classed by what else was in flight
+ * on its LUN or channel while it ran. The placement picks the busy LUN of
+ * each read LUN:
+ *
+ *   lun    the read LUN itself
+ *   ch     the next LUN on the same channel, reads on even LUNs
+ *   other  the same LUN on the next channel, reads on even channels
+ *
+ * Each pair gets MIX_SUBMITTERS threads that draw ops by the configured
+ * ratio. Reads go to random pages of the lower half of the block range,
+ * written beforehand. Programs fill blocks of the upper half of the busy
+ * LUN page by page and erases recycle them, one at a time per busy LUN, as
+ * a single open block writer would do.
+ */
+#define MIX_SUBMITTERS 2
+
+enum mix_placement {
+	MIX_SAME_LUN,
+	MIX_SAME_CH,
+	MIX_OTHER_CH,
+};
+
+static const char *mix_placement_name[] = { "lun", "ch", "other" };
+
+enum mix_state {
+	MIX_IDLE,
+	MIX_CH_PROGRAM,
+	MIX_CH_ERASE,
+	MIX_LUN_PROGRAM,
+	MIX_LUN_ERASE,
+	MIX_NSTATES,
+};
+
+static const char *mix_state_name[] = { "idle", "ch program", "ch erase", "lun program", "lun erase" };
+
+/* programs and erases in flight on a LUN or channel, and started so far */
+struct mix_busy {
+	int inflight[2];
+	unsigned int started[2];
+} __attribute__((aligned(64)));
+
+struct mix_lun {
+	omp_lock_t lock;	/* held across each program or erase */
+	int *rd_blks;		/* good blocks holding data */
+	int nrd;
+	int *pe_blks;		/* good blocks to program and erase */
+	uint8_t *erased;
+	int npe;
+	int cur;		/* open block, index into pe_blks, -1 if none */
+	int pg;			/* next page of cur */
+	int erase_next;
+};
+
+struct lat_vec {
+	uint32_t *ns;
+	size_t n;
+	size_t cap;
+};
+
+/* reads by state, then programs and erases */
+#define MIX_NLATS (MIX_NSTATES + 2)
+
+struct mix_thread {
+	struct lat_vec lat[MIX_NLATS];
+	unsigned long failed[3];
+} __attribute__((aligned(64)));
+
+static void lat_push(struct lat_vec *v, double us)
+{
+	double ns = us * 1000.0;
+
+	if (v->n == v->cap) {
+		size_t cap = v->cap ? v->cap * 2 : 4096;
+		uint32_t *p = realloc(v->ns, cap * sizeof(*p));
+
+		if (!p)
+			return;
+		v->ns = p;
+		v->cap = cap;
+	}
+
+	v->ns[v->n++] = ns > UINT32_MAX ? UINT32_MAX : ns;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void mix_busy_begin(struct mix_busy *lb, struct mix_busy *cb, int k)
+{
+	__atomic_fetch_add(&lb->inflight[k], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&lb->started[k], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&cb->inflight[k], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&cb->started[k], 1, __ATOMIC_RELAXED);
+}
+
+static void mix_busy_end(struct mix_busy *lb, struct mix_busy *cb, int k)
+{
+	__atomic_fetch_sub(&lb->inflight[k], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&cb->inflight[k], 1, __ATOMIC_RELAXED);
+}
+
+static void mix_busy_snap(const struct mix_busy *b, struct mix_busy *snap)
+{
+	for (int k = 0; k < 2; k++) {
+		snap->inflight[k] = __atomic_load_n(&b->inflight[k], __ATOMIC_RELAXED);
+		snap->started[k] = __atomic_load_n(&b->started[k], __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Worst overlap a read saw, from the counters of its LUN and channel taken
+ * before and after it. An op counts if it was in flight at the start or
+ * started before the end; channel ops exclude the read's own LUN.
+ */
+static enum mix_state mix_classify(const struct mix_busy *l0, const struct mix_busy *l1,
+				   const struct mix_busy *c0, const struct mix_busy *c1)
+{
+	for (int k = 1; k >= 0; k--)
+		if (l0->inflight[k] || l1->started[k] != l0->started[k])
+			return k ? MIX_LUN_ERASE : MIX_LUN_PROGRAM;
+
+	for (int k = 1; k >= 0; k--)
+		if (c0->inflight[k] > l0->inflight[k] ||
+		    c1->started[k] - c0->started[k] > l1->started[k] - l0->started[k])
+			return k ? MIX_CH_ERASE : MIX_CH_PROGRAM;
+
+	return MIX_IDLE;
+}
+
+/* program the next page of the open block, or erase the next block */
+static void mix_pe(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, struct mix_lun *ml, int ch, int lun,
+		   int op, void *data, void *meta, struct mix_busy *lb, struct mix_busy *cb, struct mix_thread *mt)
+{
+	int idx = -1, failed;
+	double t;
+
+	omp_set_lock(&ml->lock);
+
+	if (op == 1 && (ml->cur < 0 || ml->pg == geo->npages)) {
+		for (int i = 1; i <= ml->npe; i++) {
+			int j = (ml->cur + i + ml->npe) % ml->npe;
+
+			if (ml->erased[j]) {
+				idx = j;
+				break;
+			}
+		}
+		if (idx < 0) {
+			/* nothing erased, this one becomes an erase */
+			op = 2;
+			idx = (ml->cur + 1) % ml->npe;
+		} else {
+			ml->cur = idx;
+			ml->pg = 0;
+			ml->erased[idx] = 0;
+		}
+	} else if (op == 2) {
+		idx = ml->erase_next;
+		if (idx == ml->cur)
+			idx = (idx + 1) % ml->npe;
+		ml->erase_next = (idx + 1) % ml->npe;
+	}
+
+	mix_busy_begin(lb, cb, op - 1);
+	t = now_us();
+	if (op == 1)
+		failed = rw_pg(dev, geo, 1, ch, lun, ml->pe_blks[ml->cur], ml->pg, data, meta, fec->flag, &fec->oob, &fec->io, NULL);
+	else
+		failed = erase_blk(dev, geo, ch, lun, ml->pe_blks[idx], 0, fec->flag, &fec->io);
+	t = now_us() - t;
+	mix_busy_end(lb, cb, op - 1);
+
+	if (op == 1)
+		ml->pg = failed ? geo->npages : ml->pg + 1;
+	else
+		ml->erased[idx] = !failed;
+
+	omp_unset_lock(&ml->lock);
+
+	lat_push(&mt->lat[MIX_NSTATES + op - 1], t);
+	mt->failed[op] += !!failed;
+}
+
+static void mix_read(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, struct mix_lun *ml, int ch, int lun,
+		     unsigned int *seed, void *data, void *meta, struct mix_busy *lb, struct mix_busy *cb, struct mix_thread *mt)
+{
+	struct mix_busy l0, l1, c0, c1;
+	int blk = ml->rd_blks[rand_r(seed) % ml->nrd];
+	int pg = rand_r(seed) % geo->npages;
+	int failed;
+	double t;
+
+	mix_busy_snap(lb, &l0);
+	mix_busy_snap(cb, &c0);
+	t = now_us();
+	failed = rw_pg(dev, geo, 0, ch, lun, blk, pg, data, meta, fec->flag, &fec->oob, &fec->io, NULL);
+	t = now_us() - t;
+	mix_busy_snap(lb, &l1);
+	mix_busy_snap(cb, &c1);
+
+	lat_push(&mt->lat[mix_classify(&l0, &l1, &c0, &c1)], t);
+	mt->failed[0] += !!failed;
+}
+
+static void print_mix_row(const char *name, const struct lat_vec *v)
+{
+	double sum = 0.0;
+
+	for (size_t i = 0; i < v->n; i++)
+		sum += v->ns[i];
+
+	printf("%-17s %9zu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name, v->n,
+			sum / v->n / 1000.0,
+			v->ns[(v->n - 1) * 500 / 1000] / 1000.0,
+			v->ns[(v->n - 1) * 900 / 1000] / 1000.0,
+			v->ns[(v->n - 1) * 990 / 1000] / 1000.0,
+			v->ns[(v->n - 1) * 999 / 1000] / 1000.0,
+			v->ns[v->n - 1] / 1000.0);
+}
+
+static void print_mix_statistics(struct mix_thread *mts, int nthreads, double secs)
+{
+	unsigned long failed[3] = { 0 };
+
+	printf("\nMixed workload latency (us), read rows by what else was in flight:\n");
+	printf("%-17s %9s %9s %9s %9s %9s %9s %9s\n", "", "count", "avg", "p50", "p90", "p99", "p99.9", "max");
+
+	for (int s = 0; s < MIX_NLATS; s++) {
+		struct lat_vec all = { 0 };
+		char name[32];
+
+		for (int t = 0; t < nthreads; t++)
+			all.n += mts[t].lat[s].n;
+		if (!all.n)
+			continue;
+
+		all.ns = malloc(all.n * sizeof(uint32_t));
+		if (!all.ns)
+			continue;
+		all.n = 0;
+		for (int t = 0; t < nthreads; t++) {
+			if (!mts[t].lat[s].n)
+				continue;
+			memcpy(all.ns + all.n, mts[t].lat[s].ns, mts[t].lat[s].n * sizeof(uint32_t));
+			all.n += mts[t].lat[s].n;
+		}
+		qsort(all.ns, all.n, sizeof(uint32_t), cmp_u32);
+
+		if (s < MIX_NSTATES)
+			snprintf(name, sizeof(name), "read %s", mix_state_name[s]);
+		else
+			snprintf(name, sizeof(name), "%s", s == MIX_NSTATES ? "program" : "erase");
+		print_mix_row(name, &all);
+		free(all.ns);
+	}
+
+	for (int t = 0; t < nthreads; t++)
+		for (int op = 0; op < 3; op++)
+			failed[op] += mts[t].failed[op];
+	printf("failed: read %lu program %lu erase %lu in %.1f s\n", failed[0], failed[1], failed[2], secs);
+}
+
+/* blocks of [from, to) not in the BBT, NULL if none */
+static int *mix_good_blks(const struct nvm_geo *geo, const struct io_conf *io, const struct nvm_bbt *bbt, int from, int to, int *n)
+{
+	int *blks = malloc((to - from) * sizeof(int));
+
+	*n = 0;
+	if (!blks)
+		return NULL;
+
+	for (int blk = from; blk < to; blk++)
+		if (!blk_is_bad(geo, io, bbt, blk))
+			blks[(*n)++] = blk;
+
+	return blks;
+}
+
+static int for_each_mixed(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, const int mix[3],
+			  int placement, int secs)
+{
+	const int nluns = geo->nchannels * geo->nluns;
+	const int mid = fec->skip_blk + (fec->max_blk - fec->skip_blk) / 2;
+	const int total = mix[0] + mix[1] + mix[2];
+	int rd[nluns], busy[nluns], npairs = 0;
+	struct mix_lun *mls;
+	struct mix_busy *lbusy, *cbusy;
+	struct mix_thread *mts;
+	struct prof_stat before[PROF_NPHASES];
+	double t;
+
+	for (int ch = 0; ch < fec->max_ch; ch++) {
+		for (int lun = 0; lun < fec->max_lun; lun++) {
+			int idx = ch * geo->nluns + lun;
+
+			if (placement == MIX_SAME_CH && (lun & 1 || lun + 1 >= fec->max_lun))
+				continue;
+			if (placement == MIX_OTHER_CH && (ch & 1 || ch + 1 >= fec->max_ch))
+				continue;
+
+			rd[npairs] = idx;
+			busy[npairs] = placement == MIX_SAME_LUN ? idx :
+				       placement == MIX_SAME_CH ? idx + 1 : idx + geo->nluns;
+			npairs++;
+		}
+	}
+	if (!npairs) {
+		printf("Placement %s needs at least two %s.\n", mix_placement_name[placement],
+				placement == MIX_SAME_CH ? "LUNs per channel" : "channels");
+		return -EINVAL;
+	}
+	if (mid - fec->skip_blk < 1 || fec->max_blk - mid < 2) {
+		printf("Mixed workload needs at least 3 blocks per LUN.\n");
+		return -EINVAL;
+	}
+
+	mls = calloc(nluns, sizeof(*mls));
+	lbusy = calloc(nluns, sizeof(*lbusy));
+	cbusy = calloc(geo->nchannels, sizeof(*cbusy));
+	mts = calloc(npairs * MIX_SUBMITTERS, sizeof(*mts));
+	if (!mls || !lbusy || !cbusy || !mts) {
+		free(mls);
+		free(lbusy);
+		free(cbusy);
+		free(mts);
+		return -ENOMEM;
+	}
+
+	for (int p = 0; p < npairs; p++) {
+		for (int i = 0; i < 2; i++) {
+			int idx = i ? busy[p] : rd[p];
+			struct mix_lun *ml = &mls[idx];
+			struct nvm_bbt *bbt;
+			struct nvm_ret bbt_ret;
+			struct nvm_addr bbt_addr;
+
+			bbt_addr.ppa = 0;
+			bbt_addr.g.ch = idx / geo->nluns;
+			bbt_addr.g.lun = idx % geo->nluns;
+
+			bbt = nvm_bbt_alloc_cp(nvm_bbt_get(dev, bbt_addr, &bbt_ret));
+			if (!bbt) {
+				perror("Could not retrieve bad block table");
+				nvm_ret_pr(&bbt_ret);
+				continue;
+			}
+			if (!i)
+				ml->rd_blks = mix_good_blks(geo, &fec->io, bbt, fec->skip_blk, mid, &ml->nrd);
+			else if (!ml->pe_blks)
+				ml->pe_blks = mix_good_blks(geo, &fec->io, bbt, mid, fec->max_blk, &ml->npe);
+			nvm_bbt_free(bbt);
+		}
+	}
+
+	for (int idx = 0; idx < nluns; idx++) {
+		struct mix_lun *ml = &mls[idx];
+
+		omp_init_lock(&ml->lock);
+		ml->cur = -1;
+		ml->erased = calloc(ml->npe ? ml->npe : 1, 1);
+		if (ml->npe < 2)
+			ml->npe = 0;
+	}
+
+	/* data to read back, stamped like any other write pass */
+	printf("Writing %d read blocks per LUN\n", mid - fec->skip_blk);
+	oob_next_pass(&fec->oob);
+
+#pragma omp parallel for schedule (static)
+	for (int p = 0; p < npairs; p++) {
+		struct mix_lun *ml = &mls[rd[p]];
+		int ch = rd[p] / geo->nluns, lun = rd[p] % geo->nluns;
+		void *data = io_data(&fec->bufs, p * MIX_SUBMITTERS);
+		void *meta = io_meta(&fec->bufs, p * MIX_SUBMITTERS);
+		int n = 0;
+
+		prof_start(fec->io.prof);
+
+		for (int i = 0; i < ml->nrd; i++) {
+			int blk = ml->rd_blks[i];
+
+			if (erase_blk(dev, geo, ch, lun, blk, 0, fec->flag, &fec->io) ||
+			    rw_blk(dev, geo, 1, ch, lun, blk, 0, data, meta, fec->flag, &fec->oob, &fec->io, NULL))
+				continue;
+			ml->rd_blks[n++] = blk;
+		}
+		ml->nrd = n;
+
+		prof_lap(fec->io.prof, rd[p], PROF_BOOK);
+	}
+
+	printf("Mixed workload %d:%d:%d (read:program:erase), placement %s, %d read LUNs, %d s\n",
+			mix[0], mix[1], mix[2], mix_placement_name[placement], npairs, secs);
+	progress_pass_begin(fec->io.prog, PROGRESS_OP_MIXED, 0);
+	prof_total(fec->io.prof, before);
+
+	t = now_us();
+
+#pragma omp parallel num_threads(npairs * MIX_SUBMITTERS)
+	{
+		const int tid = omp_get_thread_num();
+		const int p = tid / MIX_SUBMITTERS;
+		const int rch = rd[p] / geo->nluns, rlun = rd[p] % geo->nluns;
+		const int bch = busy[p] / geo->nluns, blun = busy[p] % geo->nluns;
+		const double end = t + secs * 1e6;
+		struct mix_lun *rml = &mls[rd[p]], *bml = &mls[busy[p]];
+		unsigned int seed = tid ^ (unsigned int)t;
+		void *data = io_data(&fec->bufs, tid);
+		void *meta = io_meta(&fec->bufs, tid);
+
+		prof_start(fec->io.prof);
+
+		while (((rml->nrd && mix[0]) || (bml->npe && mix[0] < total)) && now_us() < end) {
+			int x = rand_r(&seed) % total;
+
+			if (x < mix[0]) {
+				if (rml->nrd)
+					mix_read(dev, geo, fec, rml, rch, rlun, &seed, data, meta,
+						 &lbusy[rd[p]], &cbusy[rch], &mts[tid]);
+			} else if (bml->npe) {
+				mix_pe(dev, geo, fec, bml, bch, blun, x < mix[0] + mix[1] ? 1 : 2, data, meta,
+				       &lbusy[busy[p]], &cbusy[bch], &mts[tid]);
+			}
+		}
+
+		prof_lap(fec->io.prof, rd[p], PROF_BOOK);
+	}
+
+	print_prof_pass(fec->io.prof, "mixed", before);
+
+	print_mix_statistics(mts, npairs * MIX_SUBMITTERS, (now_us() - t) / 1e6);
+
+	for (int i = 0; i < npairs * MIX_SUBMITTERS; i++)
+		for (int s = 0; s < MIX_NLATS; s++)
+			free(mts[i].lat[s].ns);
+	for (int idx = 0; idx < nluns; idx++) {
+		omp_destroy_lock(&mls[idx].lock);
+		free(mls[idx].rd_blks);
+		free(mls[idx].pe_blks);
+		free(mls[idx].erased);
+	}
+	free(mts);
+	free(cbusy);
+	free(lbusy);
+	free(mls);
+
+	return 0;
+}
+
+static void print_statistics(const struct nvm_geo *geo, int max_ch, int max_lun, int max_blk, int skip_blk, int report[geo->nchannels][geo->nluns][geo->nblocks])
+{
+	/* Statistics */
+	printf("Begin block notications\n");
+	printf("[CH,LN,BLK]: E W RDS\n");
+	for (int ch = 0; ch < max_ch; ch++) {
+		for (int lun = 0; lun < max_lun; lun++) {
+			for (int blk = 0; blk < max_blk; blk++) {
+				if (!report[ch][lun][blk])
+					continue;
+				printf("[%02u,%02u,%03u]: %u %u %u\n", ch, lun, blk, (report[ch][lun][blk] & 0x10000) >> 16, (report[ch][lun][blk] & 0x1000) >> 12, report[ch][lun][blk] & 0xfff);
+			}
+		}
+	}
+	printf("End block notifications\n");
+
+	printf("\nStatistics:\n");
+	printf("-----------\n");
+
+	int erase_failures = 0;
+	int write_failures = 0;
+	int read_failures = 0;
+	int skips = 0;
+	int markedbad = 0;
+	int failures = 0;
+
+	for (int ch = 0; ch < max_ch; ch++) {
+		for (int lun = 0; lun < max_lun; lun++) {
+			for (int blk = 0; blk < max_blk; blk++) {
+				if (report[ch][lun][blk] & 0x1000000)
+					markedbad++;
+				if (report[ch][lun][blk] & 0x100000)
+					skips++;
+				if (report[ch][lun][blk] & 0x10000)
+					erase_failures++;
+				if (report[ch][lun][blk] & 0x1000)
+					write_failures++;
+				if (report[ch][lun][blk] & 0xfff)
+					read_failures++;
+				if (report[ch][lun][blk])
+					failures++;
+			}
+		}
+	}
+
+	float max = max_ch * max_lun * max_blk;
+	float total = 100 * (1 / ((max - skip_blk) / (float)failures));
+
+	printf("Erase failures     : %04u\n", erase_failures);
+	printf("Write failures     : %04u\n", write_failures);
+	printf("Read blk failures  : %04u\n", read_failures);
+	printf("Skipped            : %04u\n", skips);
+	printf("Marked bad         : %04u\n", markedbad);
+
+	printf("Total capacity     : %05u/%05u %02.02f%%\n", (max_ch * max_lun * max_blk) - skip_blk, failures, total);
+}
+
+static void print_adapt_statistics(const struct for_each_conf *fec)
+{
+	const struct adapt_conf *ad = &fec->adapt;
+	const int per = fec->max_blk - fec->skip_blk;
+	uint64_t failed = 0, untested = 0;
+	int nfailed = 0;
+
+	if (!ad->luns || per <= 0)
+		return;
+
+	printf("\nAdaptive verify (failed LUNs, blocks failed in this run, untested in the last pass):\n");
+	for (int ch = 0; ch < fec->max_ch; ch++) {
+		for (int lun = 0; lun < fec->max_lun; lun++) {
+			const struct adapt_lun *al = &ad->luns[ch * ad->nluns + lun];
+			int left = adapt_unknown(fec, al);
+
+			failed += al->bad;
+			untested += al->untested + per - al->visited;
+			if (!al->failed)
+				continue;
+
+			failed += left;
+			nfailed++;
+			printf("[%02u,%02u]: %u %u\n", ch, lun, al->bad, left);
+		}
+	}
+
+	printf("LUNs failed        : %04u\n", nfailed);
+	printf("Untested           : %05lu\n", (unsigned long)untested);
+
+	if (!ad->dev_fail_pct)
+		return;
+
+	if (ad->stop)
+		printf("Device verdict     : reject, settled in the %s pass\n", op_name[ad->stop_op]);
+	else
+		printf("Device verdict     : %s, %.2f%% of blocks failed (limit %.2f%%)\n",
+		       failed * 100.0 > ad->dev_fail_pct * fec->max_ch * fec->max_lun * per ? "reject" : "accept",
+		       failed * 100.0 / ((double)fec->max_ch * fec->max_lun * per), ad->dev_fail_pct);
+}
+
+static void print_oob_statistics(const struct oob_conf *oob)
+{
+	if (!oob->enabled)
+		return;
+
+	printf("OOB corrupt        : %04u\n", oob->corrupt);
+	printf("OOB misdirected    : %04u\n", oob->misdirected);
+	printf("OOB stale          : %04u\n", oob->stale);
+}
+
+static void print_io_statistics(const struct io_conf *io, int max_ch, int max_lun)
+{
+	unsigned int total[IO_NCLASSES] = { 0 };
+	unsigned int retries = 0, recovered = 0;
+
+	printf("\nCompletions per LUN (ok, %s", io_class_name[1]);
+	for (int c = 2; c < IO_NCLASSES; c++)
+		printf(", %s", io_class_name[c]);
+	printf(", retries, recovered):\n");
+
+	for (int ch = 0; ch < max_ch; ch++) {
+		for (int lun = 0; lun < max_lun; lun++) {
+			const struct io_stats *st = &io->stats[ch * io->nluns + lun];
+			unsigned int notok = 0;
+
+			for (int c = 0; c < IO_NCLASSES; c++)
+				total[c] += st->cls[c];
+			for (int c = IO_OK + 1; c < IO_NCLASSES; c++)
+				notok += st->cls[c];
+			retries += st->retries;
+			recovered += st->recovered;
+
+			if (!notok && !st->retries)
+				continue;
+
+			printf("[%02u,%02u]:", ch, lun);
+			for (int c = 0; c < IO_NCLASSES; c++)
+				printf(" %u", st->cls[c]);
+			printf(" %u %u\n", st->retries, st->recovered);
+		}
+	}
+
+	printf("\n");
+	for (int c = 0; c < IO_NCLASSES; c++)
+		printf("%-19s: %08u\n", io_class_name[c], total[c]);
+	printf("%-19s: %08u\n", "retries", retries);
+	printf("%-19s: %08u\n", "recovered", recovered);
+}
+
+/*
+ * Worker time per phase over the whole run. Submit and wait split the
+ * synchronous I/O call by CPU time, so wait is what the device took.
+ */
+static void print_prof_statistics(const struct io_conf *io)
+{
+	struct prof_stat tot[PROF_NPHASES];
+	uint64_t wall = 0, cpu = 0;
+	int hw;
+
+	if (!io->prof)
+		return;
+
+	prof_total(io->prof, tot);
+	for (int ph = 0; ph < PROF_NPHASES; ph++) {
+		wall += tot[ph].wall_ns;
+		cpu += tot[ph].cpu_ns;
+	}
+	if (!wall)
+		return;
+
+	hw = io->prof->mode >= PROF_HW_USER;
+	printf("\nTime per phase (%s):\n", prof_mode_name(io->prof->mode));
+	printf("%-15s %10s %6s %10s %10s %10s %5s\n", "phase", "wall ms", "share", "cpu ms", "cycles/op",
+	       "instrs/op", "IPC");
+	for (int ph = 0; ph < PROF_NPHASES; ph++) {
+		const struct prof_stat *st = &tot[ph];
+
+		printf("%-15s %10.1f %5.1f%% %10.1f", prof_phase_name(ph), st->wall_ns / 1e6, 100.0 * st->wall_ns / wall,
+		       st->cpu_ns / 1e6);
+		if (hw && st->n && st->cycles)
+			printf(" %10lu %10lu %5.2f\n", (unsigned long)(st->cycles / st->n),
+			       (unsigned long)(st->instrs / st->n), (double)st->instrs / st->cycles);
+		else
+			printf(" %10s %10s %5s\n", "-", "-", "-");
+	}
+
+	/* the rest is threads idling at barriers or locks */
+	printf("Host CPU %.1f%%, device wait %.1f%%: %s-bound\n", 100.0 * cpu / wall,
+	       100.0 * tot[PROF_WAIT].wall_ns / wall, tot[PROF_WAIT].wall_ns > cpu ? "device" : "host");
+}
+
+/*
+ * Per pass totals, plus how many read sectors failed in any read pass versus
+ * in every read pass, which separates persistent from intermittent failures.
+ */
+static void print_failmap_statistics(const struct nvm_geo *geo, const struct fail_map *fm)
+{
+	uint64_t any = 0, every = 0;
+	size_t nbytes = 0;
+	int nreads = 0;
+
+	if (!fm->npasses)
+		return;
+
+	printf("\nFailed sectors per pass:\n");
+	for (int p = 0; p < fm->npasses; p++) {
+		const struct fail_pass *pass = &fm->passes[p];
+		uint64_t nsecs = 0;
+		int nblks = 0;
+
+		for (int l = 0; l < fm->nluns; l++) {
+			const struct fail_lun *fl = &pass->luns[l];
+
+			nblks += fl->nblks;
+			nbytes += fl->cap * sizeof(struct fail_blk);
+			for (int i = 0; i < fl->nblks; i++) {
+				nsecs += runmap_count(&fl->blks[i].map);
+				nbytes += runmap_nbytes(&fl->blks[i].map);
+			}
+		}
+		printf("  %02d %-5s: %08lu sectors in %05d blocks\n", p, op_name[pass->op], (unsigned long)nsecs, nblks);
+		if (pass->op == 0)
+			nreads++;
+	}
+
+	for (int l = 0; nreads && l < fm->nluns; l++) {
+		struct runmap *u = calloc(geo->nblocks, sizeof(*u));
+		struct runmap *x = calloc(geo->nblocks, sizeof(*x));
+		int *seen = calloc(geo->nblocks, sizeof(int));
+		struct runmap tmp = RUNMAP_INIT;
+
+		if (!u || !x || !seen) {
+			free(u);
+			free(x);
+			free(seen);
+			break;
+		}
+
+		for (int p = 0; p < fm->npasses; p++) {
+			const struct fail_lun *fl = &fm->passes[p].luns[l];
+
+			if (fm->passes[p].op != 0)
+				continue;
+
+			for (int i = 0; i < fl->nblks; i++) {
+				const struct fail_blk *fb = &fl->blks[i];
+
+				runmap_union(&tmp, &u[fb->blk], &fb->map);
+				runmap_copy(&u[fb->blk], &tmp);
+				if (seen[fb->blk]++)
+					runmap_intersect(&tmp, &x[fb->blk], &fb->map);
+				else
+					runmap_copy(&tmp, &fb->map);
+				runmap_copy(&x[fb->blk], &tmp);
+			}
+		}
+
+		for (int blk = 0; blk < geo->nblocks; blk++) {
+			any += runmap_count(&u[blk]);
+			if (seen[blk] == nreads)
+				every += runmap_count(&x[blk]);
+			runmap_free(&u[blk]);
+			runmap_free(&x[blk]);
+		}
+
+		runmap_free(&tmp);
+		free(seen);
+		free(x);
+		free(u);
+	}
+
+	if (nreads) {
+		printf("Read sectors failed in any pass  : %08lu\n", (unsigned long)any);
+		printf("Read sectors failed in every pass: %08lu\n", (unsigned long)every);
+	}
+	printf("Failure map memory : %zu bytes\n", nbytes);
+}
+
+/*
+ * One line per failing block and pass:
+ *   test pass op ch lun blk nsectors runs
+ */
+static void failmap_export(const struct nvm_geo *geo, struct fail_map *fm)
+{
+	if (!fm->export)
+		return;
+
+	if (!fm->ntests++) {
+		fprintf(fm->export, "# lnvm failmap v1 nchannels %zu nluns %zu nplanes %zu nblocks %zu npages %zu nsectors %zu\n",
+			(size_t)geo->nchannels, (size_t)geo->nluns, (size_t)geo->nplanes,
+			(size_t)geo->nblocks, (size_t)geo->npages, (size_t)geo->nsectors);
+		fprintf(fm->export, "# bit = (pg * nplanes + pl) * nsectors + sec\n");
+		fprintf(fm->export, "# test pass op ch lun blk nsectors runs\n");
+	}
+
+	for (int p = 0; p < fm->npasses; p++) {
+		const struct fail_pass *pass = &fm->passes[p];
+
+		for (int l = 0; l < fm->nluns; l++) {
+			const struct fail_lun *fl = &pass->luns[l];
+
+			for (int i = 0; i < fl->nblks; i++) {
+				fprintf(fm->export, "%d %d %s %d %d %u %lu ", fm->ntests - 1, p, op_name[pass->op],
+					l / (int)geo->nluns, l % (int)geo->nluns, fl->blks[i].blk,
+					(unsigned long)runmap_count(&fl->blks[i].map));
+				runmap_fprint(fm->export, &fl->blks[i].map);
+				fputc('\n', fm->export);
+			}
+		}
+	}
+	fflush(fm->export);
+}
+
+static int failmap_init(const struct nvm_geo *geo, struct fail_map *fm, struct arguments *args)
+{
+	memset(fm, 0, sizeof(*fm));
+	fm->nluns = geo->nchannels * geo->nluns;
+
+	if (!args->failmap)
+		return 0;
+
+	fm->export = fopen(args->failmap, "w");
+	if (!fm->export) {
+		perror("Could not open failure map file");
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void failmap_free(struct fail_map *fm)
+{
+	failmap_reset(fm);
+	if (fm->export)
+		fclose(fm->export);
+	fm->export = NULL;
+}
+
+static int io_init(const struct nvm_geo *geo, struct io_conf *io, struct arguments *args)
+{
+	io->retries = args->retries_set ? args->retries : 2;
+	io->backoff_us = args->backoff_set ? args->backoff_us : 1000;
+	io->nluns = geo->nluns;
+	io->layout = io_layout(geo);
+	io->sector_nbytes = geo->sector_nbytes;
+	io->stats = calloc(geo->nchannels * geo->nluns, sizeof(struct io_stats));
+	if (!io->stats)
+		return -ENOMEM;
+
+	io->prog = NULL;
+	if (args->progress || args->interval) {
+		io->prog = progress_create(args->progress, geo->nchannels, geo->nluns, args->interval);
+		if (!io->prog) {
+			free(io->stats);
+			return -EINVAL;
+		}
+	}
+
+	io->prof = NULL;
+	if (args->profile) {
+		io->prof = prof_create(geo->nchannels * geo->nluns);
+		if (!io->prof) {
+			progress_destroy(io->prog);
+			free(io->stats);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void io_free(struct io_conf *io)
+{
+	prof_destroy(io->prof);
+	progress_destroy(io->prog);
+	free(io->stats);
+}
+
+static void io_reset(const struct nvm_geo *geo, struct io_conf *io)
+{
+	memset(io->stats, 0, geo->nchannels * geo->nluns * sizeof(struct io_stats));
+	prof_reset(io->prof);
+}
+
+static int io_bufs_init(const struct nvm_geo *geo, struct io_bufs *bufs, size_t nslots, int hugepages)
+{
+	struct bufpool *pool;
+
+	memset(bufs, 0, sizeof(*bufs));
+	bufs->data_nbytes = (geo->nplanes * geo->nsectors * geo->sector_nbytes + 4095) & ~4095UL;
+	bufs->meta_nbytes = (geo->nplanes * geo->nsectors * geo->meta_nbytes + 63) & ~63UL;
+
+	pool = bufpool_create(nslots * (bufs->data_nbytes + bufs->meta_nbytes) + 4096, hugepages);
+	if (!pool)
+		return -ENOMEM;
+
+	bufs->pool = pool;
+	bufs->data = bufpool_get(pool, nslots * bufs->data_nbytes, 4096);
+	if (bufs->meta_nbytes)
+		bufs->meta = bufpool_get(pool, nslots * bufs->meta_nbytes, 64);
+
+	printf("I/O buffers: %zu KB on %s pages", pool->nbytes >> 10, bufpool_backing_name(pool->backing));
+	if (pool->backing != pool->want)
+		printf(" (%s %s)", bufpool_backing_name(pool->want), bufpool_fallback_name(pool->fallback));
+	printf("\n");
+
+	return 0;
+}
+
+static void io_bufs_free(struct io_bufs *bufs)
+{
+	bufpool_destroy(bufs->pool);
+	bufs->pool = NULL;
+}
+
+static int results_init(const struct nvm_geo *geo, struct for_each_conf *fec, struct arguments *args)
+{
+	fec->results = NULL;
+	if (!args->archive)
+		return 0;
+
+	fec->results = calloc(geo->nchannels * geo->nluns * geo->nblocks, sizeof(struct blk_result));
+	if (!fec->results)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int adapt_init(const struct nvm_geo *geo, struct for_each_conf *fec, struct arguments *args)
+{
+	struct adapt_conf *ad = &fec->adapt;
+
+	memset(ad, 0, sizeof(*ad));
+	if (!args->lun_fail_pct && !args->dev_fail_pct)
+		return 0;
+
+	ad->lun_fail_pct = args->lun_fail_pct;
+	ad->downgrade = args->downgrade;
+	ad->dev_fail_pct = args->dev_fail_pct;
+	ad->nluns = geo->nluns;
+	ad->luns = calloc(geo->nchannels * geo->nluns, sizeof(struct adapt_lun));
+	ad->kept = malloc((size_t)geo->nchannels * geo->nluns * geo->nblocks);
+	if (!ad->luns || !ad->kept) {
+		free(ad->luns);
+		free(ad->kept);
+		ad->luns = NULL;
+		ad->kept = NULL;
+		return -ENOMEM;
+	}
+	memset(ad->kept, 1, (size_t)geo->nchannels * geo->nluns * geo->nblocks);
+
+	return 0;
+}
+
+static uint16_t results_lat(const struct blk_result *r, int op)
+{
+	uint64_t us;
+
+	if (!r->nlat[op])
+		return 0;
+
+	us = r->lat_us[op] / r->nlat[op];
+	return us > UINT16_MAX ? UINT16_MAX : us;
 }
 
-static void print_statistics(const struct nvm_geo *geo, int max_ch, int max_lun, int max_blk, int skip_blk, int report[geo->nchannels][geo->nluns][geo->nblocks])
+/* one record per block visited, in key order */
+static void results_archive(const struct nvm_geo *geo, struct for_each_conf *fec, struct arguments *args)
 {
-	/* Statistics */
-	printf("Begin block notications\n");
-	printf("[CH,LN,BLK]: E W RDS\n");
-	for (int ch = 0; ch < max_ch; ch++) {
-		for (int lun = 0; lun < max_lun; lun++) {
-			for (int blk = 0; blk < max_blk; blk++) {
-				if (!report[ch][lun][blk])
-					continue;
-				printf("[%02u,%02u,%03u]: %u %u %u\n", ch, lun, blk, (report[ch][lun][blk] & 0x10000) >> 16, (report[ch][lun][blk] & 0x1000) >> 12, report[ch][lun][blk] & 0xfff);
-			}
-		}
+	char devid[ARCHIVE_DEVID_LEN];
+	const char *source = "--id";
+	struct archive_rec *recs;
+	uint32_t nrecs = 0;
+	int ret;
+
+	if (!fec->results)
+		return;
+
+	recs = calloc(fec->max_ch * fec->max_lun * fec->max_blk, sizeof(*recs));
+	if (!recs) {
+		printf("Could not allocate archive records. Run not archived.\n");
+		return;
 	}
-	printf("End block notifications\n");
 
-	printf("\nStatistics:\n");
-	printf("-----------\n");
+	for (int ch = 0; ch < fec->max_ch; ch++) {
+		for (int lun = 0; lun < fec->max_lun; lun++) {
+			for (int blk = fec->skip_blk; blk < fec->max_blk; blk++) {
+				struct blk_result *r = blk_result(geo, fec, ch, lun, blk);
+				struct archive_rec *rec = &recs[nrecs];
 
-	int erase_failures = 0;
-	int write_failures = 0;
-	int read_failures = 0;
-	int skips = 0;
-	int markedbad = 0;
-	int failures = 0;
+				if (!r->flags && !r->nlat[0] && !r->nlat[1] && !r->nlat[2])
+					continue;
 
-	for (int ch = 0; ch < max_ch; ch++) {
-		for (int lun = 0; lun < max_lun; lun++) {
-			for (int blk = 0; blk < max_blk; blk++) {
-				if (report[ch][lun][blk] & 0x1000000)
-					markedbad++;
-				if (report[ch][lun][blk] & 0x100000)
-					skips++;
-				if (report[ch][lun][blk] & 0x10000)
-					erase_failures++;
-				if (report[ch][lun][blk] & 0x1000)
-					write_failures++;
-				if (report[ch][lun][blk] & 0xfff)
-					read_failures++;
-				if (report[ch][lun][blk])
-					failures++;
+				rec->key = ARCHIVE_KEY(ch, lun, blk);
+				rec->read_fails = r->read_fails;
+				rec->flags = r->flags;
+				for (int op = 0; op < 3; op++)
+					rec->lat_us[op] = results_lat(r, op);
+				nrecs++;
 			}
 		}
 	}
 
-	float max = max_ch * max_lun * max_blk;
-	float total = 100 * (1 / ((max - skip_blk) / (float)failures));
+	if (args->archive_id)
+		snprintf(devid, sizeof(devid), "%s", args->archive_id);
+	else
+		source = archive_devid(devid, args->devname, geo->nchannels, geo->nluns, geo->nblocks, geo->npages,
+				       geo->nsectors, geo->sector_nbytes);
 
-	printf("Erase failures     : %04u\n", erase_failures);
-	printf("Write failures     : %04u\n", write_failures);
-	printf("Read blk failures  : %04u\n", read_failures);
-	printf("Skipped            : %04u\n", skips);
-	printf("Marked bad         : %04u\n", markedbad);
+	ret = archive_append(args->archive, devid, geo->nchannels, geo->nluns, geo->nblocks, geo->npages, recs, nrecs);
+	if (ret)
+		printf("Could not archive run to %s/%s: %s\n", args->archive, devid, strerror(-ret));
+	else
+		printf("\nArchived %u blocks to %s/%s (id from %s)\n", nrecs, args->archive, devid, source);
 
-	printf("Total capacity     : %05u/%05u %02.02f%%\n", (max_ch * max_lun * max_blk) - skip_blk, failures, total);
+	free(recs);
 }
 
 static int dev_verify(struct arguments *args)
@@ -259,8 +2346,8 @@ static int dev_verify(struct arguments *args)
 	struct nvm_dev *dev;
 	const struct nvm_geo *geo;
 	struct for_each_conf fec;
+	struct fail_map fm;
 	int max_ch, max_lun, max_blk, skip_blk;
-	void *buf;
 
 	dev = nvm_dev_open(args->devname);
 	if (!dev) {
@@ -290,17 +2377,46 @@ static int dev_verify(struct arguments *args)
 	memset(&report, 0, sizeof(report));
 
 	/* Parameters end */
-	buf = nvm_buf_alloc(geo, geo->nplanes * geo->nsectors * geo->sector_nbytes);
+	memset(&fec, 0, sizeof(fec));
+	if (io_bufs_init(geo, &fec.bufs, geo->nchannels * geo->nluns * (args->mixed ? MIX_SUBMITTERS : 1), args->hugepages)) {
+		printf("Could not allocate I/O buffers.\n");
+		return -ENOMEM;
+	}
 
 	fec.max_ch = max_ch;
 	fec.max_lun = max_lun;
 	fec.max_blk = max_blk;
 	fec.skip_blk = skip_blk;
-	fec.data = buf;
-	fec.meta = buf;
 	fec.flag = geo->nplanes >> 1;
 	fec.show_time = args->show_time;
 	fec.dry_run = args->dry_run;
+	oob_init(geo, &fec.oob, args->no_oob, args->oob_fail);
+	if (io_init(geo, &fec.io, args)) {
+		printf("Could not set up I/O statistics.\n");
+		io_bufs_free(&fec.bufs);
+		return -ENOMEM;
+	}
+	if (failmap_init(geo, &fm, args)) {
+		io_free(&fec.io);
+		io_bufs_free(&fec.bufs);
+		return -EINVAL;
+	}
+	fec.fails = &fm;
+	if (results_init(geo, &fec, args)) {
+		printf("Could not allocate archive results.\n");
+		failmap_free(&fm);
+		io_free(&fec.io);
+		io_bufs_free(&fec.bufs);
+		return -ENOMEM;
+	}
+	if (adapt_init(geo, &fec, args)) {
+		printf("Could not allocate adaptive verify state.\n");
+		free(fec.results);
+		failmap_free(&fm);
+		io_free(&fec.io);
+		io_bufs_free(&fec.bufs);
+		return -ENOMEM;
+	}
 
 	if (args->plane_hint) {
 		if (geo->nplanes < args->plane_hint) {
@@ -311,27 +2427,52 @@ static int dev_verify(struct arguments *args)
 		}
 	}
 
+	if (args->line_mode) {
+		printf("Performing line %s%s%s\n", args->do_erase ? "erases " : "",
+				args->do_write ? "writes " : "", args->do_read ? "reads" : "");
+		for_each_line(dev, geo, &fec, args->do_erase << 2 | args->do_write << 1 | args->do_read, report);
+		args->do_erase = args->do_write = args->do_read = 0;
+	}
+
+	if (args->mixed) {
+		for_each_mixed(dev, geo, &fec, args->mix, args->placement, args->duration ? args->duration : 10);
+		args->do_erase = args->do_write = args->do_read = 0;
+	}
+
 	if (args->do_erase) {
 		fec.op = 2;
 		printf("Performing erases\n");
 		for_each_blk(dev, geo, &fec, report);
 	}
 
-	if (args->do_write) {
+	if (args->do_write && !fec.adapt.stop) {
 		fec.op = 1;
+		oob_next_pass(&fec.oob);
 		printf("Performing writes\n");
 		for_each_blk(dev, geo, &fec, report);
 	}
 
-	if (args->do_read) {
+	if (args->do_read && !fec.adapt.stop) {
 		fec.op = 0;
 		printf("Performing reads\n");
 		for_each_blk(dev, geo, &fec, report);
 	}
 
 	print_statistics(geo, fec.max_ch, fec.max_lun, fec.max_blk, fec.skip_blk, report);
-
-	free(buf);
+	print_adapt_statistics(&fec);
+	print_oob_statistics(&fec.oob);
+	print_io_statistics(&fec.io, fec.max_ch, fec.max_lun);
+	print_prof_statistics(&fec.io);
+	print_failmap_statistics(geo, &fm);
+	failmap_export(geo, &fm);
+	results_archive(geo, &fec, args);
+
+	free(fec.adapt.luns);
+	free(fec.adapt.kept);
+	free(fec.results);
+	failmap_free(&fm);
+	io_free(&fec.io);
+	io_bufs_free(&fec.bufs);
 	return 0;
 }
 
@@ -348,6 +2489,24 @@ static struct argp_option opt_dev_verify[] =
 	{"maxblk", 'b', "max_blk", 0, "Limit Blocks to 0..Z"},
 	{"skipblk", 's', "skip_blk", 0, "Skip first blocks to X..BLKS"},
 	{"planehint", 'p', "plane_hint", 0, "1 Single plane, 2 dual plane, 4 quad plane"},
+	{"nooob", 'o', 0, 0, "Do not stamp and verify per-sector OOB signatures"},
+	{"oobfail", 'O', 0, 0, "Fail, and so mark bad, blocks written in this run whose OOB signatures do not read back"},
+	{"retries", 'R', "retries", 0, "Retry timed out or aborted commands up to N times (default 2)"},
+	{"backoff", 'B', "usecs", 0, "Delay before the first retry, doubled per retry (default 1000)"},
+	{"failmap", 'f', "FILE", 0, "Write failed sectors per block and pass to FILE"},
+	{"line", 'L', 0, 0, "Erase, write and read whole lines across all LUNs, striped like pblk"},
+	{"progress", 'P', "FILE", 0, "Export live progress to FILE, e.g. under /dev/shm, for monitors"},
+	{"interval", 'i', "secs", 0, "Print a progress line to stderr every secs seconds"},
+	{"hugepages", 'H', "SIZE", 0, "Back I/O buffers with 1g or 2m hugetlb pages or thp, falling back to smaller pages"},
+	{"profile", 'C', 0, 0, "Split worker time into address build, pattern gen, submit, wait, verify and bookkeeping"},
+	{"mixed", 'm', "R:W:E", 0, "Run reads, programs and erases at this ratio and report read latency by what else was in flight"},
+	{"placement", 'x', "WHERE", 0, "Mixed: programs and erases on the read LUN (lun, default), the same channel (ch) or another channel (other)"},
+	{"duration", 'D', "secs", 0, "Mixed: run for secs seconds (default 10)"},
+	{"archive", 'a', "DIR", 0, "Append per-block results of this run to the archive in DIR"},
+	{"id", 'I', "ID", 0, "Archive under ID instead of the device serial, WWID or name and geometry"},
+	{"lunfail", 'F', "PCT", 0, "Declare a LUN failed once more than PCT% of its blocks fail, and stop testing it; tests neighbors of failed blocks first"},
+	{"downgrade", 'g', "N", 0, "With -F: keep testing every Nth block of a failed LUN instead of stopping"},
+	{"devfail", 'V', "PCT", 0, "Stop once more than PCT% of all blocks are certain to fail; tests neighbors of failed blocks first"},
 	{0}
 };
 
@@ -356,7 +2515,17 @@ static char doc_dev_verify[] =
 		" Verify disk by writing to all good blocks and read them back. Marks blocks bad if found.\n"
 		"  lnvm verify /dev/nvme0n1\n"
 		" Verify disk with a dry-run. Only overwrite disk and read back data and report state. Do not mark blocks.\n"
-		"  lnvm verify -d /dev/nvme0n1\n";
+		"  lnvm verify -d /dev/nvme0n1\n"
+		" Verify line by line the way pblk writes, reporting bandwidth and latency per line.\n"
+		"  lnvm verify -L -d /dev/nvme0n1\n"
+		" Measure read latency while the same channel is busy with 1 program per 4 reads and 1 erase per 40.\n"
+		"  lnvm verify -m 40:10:1 -x ch -n -d /dev/nvme0n1\n"
+		" Give up on LUNs failing more than 20% of blocks and reject the drive as soon as over 5% surely fail.\n"
+		"  lnvm verify -F 20 -V 5 -d /dev/nvme0n1\n"
+		" Show whether a verify run is bound by host CPU or by the device.\n"
+		"  lnvm verify -C -d /dev/nvme0n1\n"
+		" Verify and keep the per-block results for later trend queries.\n"
+		"  lnvm verify -a /var/lib/lnvm -d /dev/nvme0n1\n";
 
 static error_t parse_dev_verify_opt(int key, char *arg, struct argp_state *state)
 {
@@ -439,6 +2608,149 @@ static error_t parse_dev_verify_opt(int key, char *arg, struct argp_state *state
 		args->plane_hint = atoi(arg);
 		args->arg_num++;
 		break;
+	case 'o':
+		if (args->no_oob)
+			argp_usage(state);
+		args->no_oob = 1;
+		args->arg_num++;
+		break;
+	case 'O':
+		if (args->oob_fail)
+			argp_usage(state);
+		args->oob_fail = 1;
+		args->arg_num++;
+		break;
+	case 'P':
+		if (!arg || args->progress)
+			argp_usage(state);
+		args->progress = arg;
+		args->arg_num++;
+		break;
+	case 'i':
+		if (!arg || args->interval)
+			argp_usage(state);
+		args->interval = atoi(arg);
+		args->arg_num++;
+		break;
+	case 'L':
+		if (args->line_mode)
+			argp_usage(state);
+		args->line_mode = 1;
+		args->arg_num++;
+		break;
+	case 'f':
+		if (!arg || args->failmap)
+			argp_usage(state);
+		args->failmap = arg;
+		args->arg_num++;
+		break;
+	case 'R':
+		if (!arg || args->retries_set)
+			argp_usage(state);
+		args->retries_set = 1;
+		args->retries = atoi(arg);
+		args->arg_num++;
+		break;
+	case 'B':
+		if (!arg || args->backoff_set)
+			argp_usage(state);
+		args->backoff_set = 1;
+		args->backoff_us = atoi(arg);
+		args->arg_num++;
+		break;
+	case 'H':
+		if (!arg || args->hugepages)
+			argp_usage(state);
+		args->hugepages = bufpool_parse(arg);
+		if (args->hugepages < 0) {
+			printf("Unknown page size: %s\n", arg);
+			argp_usage(state);
+		}
+		args->arg_num++;
+		break;
+	case 'C':
+		if (args->profile)
+			argp_usage(state);
+		args->profile = 1;
+		args->arg_num++;
+		break;
+	case 'F':
+		if (!arg || args->lun_fail_pct)
+			argp_usage(state);
+		args->lun_fail_pct = atof(arg);
+		if (args->lun_fail_pct <= 0 || args->lun_fail_pct >= 100) {
+			printf("LUN failure threshold must be between 0 and 100%%: %s\n", arg);
+			argp_usage(state);
+		}
+		args->arg_num++;
+		break;
+	case 'g':
+		if (!arg || args->downgrade)
+			argp_usage(state);
+		args->downgrade = atoi(arg);
+		if (args->downgrade < 1)
+			argp_usage(state);
+		args->arg_num++;
+		break;
+	case 'V':
+		if (!arg || args->dev_fail_pct)
+			argp_usage(state);
+		args->dev_fail_pct = atof(arg);
+		if (args->dev_fail_pct <= 0 || args->dev_fail_pct >= 100) {
+			printf("Device failure limit must be between 0 and 100%%: %s\n", arg);
+			argp_usage(state);
+		}
+		args->arg_num++;
+		break;
+	case 'm':
+		if (!arg || args->mixed)
+			argp_usage(state);
+		if (sscanf(arg, "%d:%d:%d", &args->mix[0], &args->mix[1], &args->mix[2]) != 3 ||
+		    args->mix[0] < 1 || args->mix[1] < 0 || args->mix[2] < 0) {
+			printf("Expected reads:programs:erases, with reads > 0\n");
+			argp_usage(state);
+		}
+		args->mixed = 1;
+		args->arg_num++;
+		break;
+	case 'x':
+		if (!arg || args->placement_set)
+			argp_usage(state);
+		if (!strcmp(arg, "lun"))
+			args->placement = MIX_SAME_LUN;
+		else if (!strcmp(arg, "ch"))
+			args->placement = MIX_SAME_CH;
+		else if (!strcmp(arg, "other"))
+			args->placement = MIX_OTHER_CH;
+		else
+			argp_usage(state);
+		args->placement_set = 1;
+		args->arg_num++;
+		break;
+	case 'D':
+		if (!arg || args->duration)
+			argp_usage(state);
+		args->duration = atoi(arg);
+		if (args->duration < 1)
+			argp_usage(state);
+		args->arg_num++;
+		break;
+	case 'a':
+		if (!arg || args->archive)
+			argp_usage(state);
+		args->archive = arg;
+		args->arg_num++;
+		break;
+	case 'I':
+		if (!arg || args->archive_id)
+			argp_usage(state);
+		if (strlen(arg) >= ARCHIVE_DEVID_LEN || strchr(arg, '/')) {
+			printf("Invalid archive id\n");
+			argp_usage(state);
+		}
+		args->archive_id = arg;
+		args->arg_num++;
+		break;
 	case ARGP_KEY_ARG:
 		if (args->arg_num > 9)
 			argp_usage(state);
@@ -448,6 +2760,10 @@ static error_t parse_dev_verify_opt(int key, char *arg, struct argp_state *state
 			argp_usage(state);
 		if (args->arg_num < 1)
 			argp_usage(state);
+		if (args->downgrade && !args->lun_fail_pct)
+			argp_usage(state);
+		if ((args->placement_set || args->duration) && !args->mixed)
+			argp_usage(state);
 		break;
 	default:
 		return ARGP_ERR_UNKNOWN;
@@ -487,6 +2803,10 @@ static void cmd_dev_verify(struct argp_state *state, struct arguments *args)
 void test_plane(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_conf *fec, int report[geo->nchannels][geo->nluns][geo->nblocks],
 				int rflag, int wflag, int eflag)
 {
+	fec->oob.corrupt = fec->oob.misdirected = fec->oob.stale = 0;
+	io_reset(geo, &fec->io);
+	failmap_reset(fec->fails);
+
 	fec->flag = eflag;
 	fec->op = 2;
 	printf("Performing erases\n");
@@ -494,6 +2814,7 @@ void test_plane(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_
 
 	fec->flag = wflag;
 	fec->op = 1;
+	oob_next_pass(&fec->oob);
 	printf("Performing writes\n");
 	for_each_blk(dev, geo, fec, report);
 
@@ -506,6 +2827,11 @@ void test_plane(struct nvm_dev *dev, const struct nvm_geo *geo, struct for_each_
 	}
 
 	print_statistics(geo, fec->max_ch, fec->max_lun, fec->max_blk, fec->skip_blk, report);
+	print_oob_statistics(&fec->oob);
+	print_io_statistics(&fec->io, fec->max_ch, fec->max_lun);
+	print_prof_statistics(&fec->io);
+	print_failmap_statistics(geo, fec->fails);
+	failmap_export(geo, fec->fails);
 }
 
 static int dev_plane(struct arguments *args)
@@ -513,8 +2839,8 @@ static int dev_plane(struct arguments *args)
 	struct nvm_dev *dev;
 	const struct nvm_geo *geo;
 	struct for_each_conf fec;
+	struct fail_map fm;
 	int max_ch, max_lun, max_blk, skip_blk;
-	void *buf;
 
 	dev = nvm_dev_open(args->devname);
 	if (!dev) {
@@ -544,16 +2870,30 @@ static int dev_plane(struct arguments *args)
 	memset(&report, 0, sizeof(report));
 
 	/* Parameters end */
-	buf = nvm_buf_alloc(geo, geo->nplanes * geo->nsectors * geo->sector_nbytes);
+	memset(&fec, 0, sizeof(fec));
+	if (io_bufs_init(geo, &fec.bufs, geo->nchannels * geo->nluns, args->hugepages)) {
+		printf("Could not allocate I/O buffers.\n");
+		return -ENOMEM;
+	}
 
 	fec.max_ch = max_ch;
 	fec.max_lun = max_lun;
 	fec.max_blk = max_blk;
 	fec.skip_blk = skip_blk;
-	fec.data = buf;
-	fec.meta = buf;
 	fec.flag = geo->nplanes >> 1;
 	fec.show_time = args->show_time;
+	oob_init(geo, &fec.oob, args->no_oob, args->oob_fail);
+	if (io_init(geo, &fec.io, args)) {
+		printf("Could not set up I/O statistics.\n");
+		io_bufs_free(&fec.bufs);
+		return -ENOMEM;
+	}
+	if (failmap_init(geo, &fm, args)) {
+		io_free(&fec.io);
+		io_bufs_free(&fec.bufs);
+		return -EINVAL;
+	}
+	fec.fails = &fm;
 
 	/* Test 1 Simple */
 	printf("1. Single Erase, Write, Read Test\n");
@@ -613,7 +2953,9 @@ static int dev_plane(struct arguments *args)
 		memset(&report, 0, sizeof(report));
 	}
 
-	free(buf);
+	failmap_free(&fm);
+	io_free(&fec.io);
+	io_bufs_free(&fec.bufs);
 
 	return 0;
 }
@@ -629,6 +2971,15 @@ static struct argp_option opt_dev_plane[] =
 	{"maxlun", 'l', "max_lun", 0, "Limit LUNs to 0..Y"},
 	{"maxblk", 'b', "max_blk", 0, "Limit Blocks to 0..Z"},
 	{"skipblk", 's', "skip_blk", 0, "Skip first blocks to X..BLKS"},
+	{"nooob", 'o', 0, 0, "Do not stamp and verify per-sector OOB signatures"},
+	{"oobfail", 'O', 0, 0, "Fail, and so mark bad, blocks written in this run whose OOB signatures do not read back"},
+	{"retries", 'R', "retries", 0, "Retry timed out or aborted commands up to N times (default 2)"},
+	{"backoff", 'B', "usecs", 0, "Delay before the first retry, doubled per retry (default 1000)"},
+	{"failmap", 'f', "FILE", 0, "Write failed sectors per block and pass to FILE"},
+	{"progress", 'P', "FILE", 0, "Export live progress to FILE, e.g. under /dev/shm, for monitors"},
+	{"interval", 'i', "secs", 0, "Print a progress line to stderr every secs seconds"},
+	{"hugepages", 'H', "SIZE", 0, "Back I/O buffers with 1g or 2m hugetlb pages or thp, falling back to smaller pages"},
+	{"profile", 'C', 0, 0, "Split worker time into address build, pattern gen, submit, wait, verify and bookkeeping"},
 	{0}
 };
 
@@ -665,11 +3016,315 @@ static void cmd_dev_plane(struct argp_state *state, struct arguments *args)
 	state->next += argc - 1;
 }
 
+struct hist_sum {
+	uint32_t nblks;
+	uint32_t skipped;
+	uint32_t bad;
+	uint32_t fails[3];	/* blocks failing read, write, erase */
+	uint64_t read_fails;
+	uint64_t lat_us[3];
+	uint32_t nlat[3];
+};
+
+static void hist_add(struct hist_sum *h, const struct archive_rec *rec)
+{
+	static const uint8_t fail_flag[] = { ARCHIVE_READ_FAIL, ARCHIVE_WRITE_FAIL, ARCHIVE_ERASE_FAIL };
+
+	h->nblks++;
+	h->skipped += !!(rec->flags & ARCHIVE_SKIPPED);
+	h->bad += !!(rec->flags & ARCHIVE_MARKED_BAD);
+	h->read_fails += rec->read_fails;
+	for (int op = 0; op < 3; op++) {
+		h->fails[op] += !!(rec->flags & fail_flag[op]);
+		if (rec->lat_us[op]) {
+			h->lat_us[op] += rec->lat_us[op];
+			h->nlat[op]++;
+		}
+	}
+}
+
+static double hist_lat(const struct hist_sum *h, int op)
+{
+	return h->nlat[op] ? (double)h->lat_us[op] / h->nlat[op] : 0.0;
+}
+
+/* a lookup per LUN at most, each a binary search over the run's records */
+static int hist_run(const struct archive *ar, uint32_t run, struct arguments *args, struct archive_rec *recs, struct hist_sum *h)
+{
+	const struct archive_hdr *hdr = &ar->hdr;
+	int max = hdr->nluns * hdr->nblocks;
+	uint32_t ch_lo = args->ch_set ? args->ch : 0, ch_hi = args->ch_set ? args->ch : hdr->nchannels - 1;
+	uint32_t lun_lo = args->lun_set ? args->lun : 0, lun_hi = args->lun_set ? args->lun : hdr->nluns - 1;
+	uint32_t blk_lo = args->blk_set ? args->blk : 0, blk_hi = args->blk_set ? args->blk : hdr->nblocks - 1;
+
+	memset(h, 0, sizeof(*h));
+
+	for (uint32_t ch = ch_lo; ch <= ch_hi; ch++) {
+		for (uint32_t lun = lun_lo; lun <= lun_hi; lun++) {
+			uint32_t key_lo = ARCHIVE_KEY(ch, lun, blk_lo);
+			uint32_t key_hi = ARCHIVE_KEY(ch, lun, blk_hi);
+			int n;
+
+			/* whole channel is one contiguous key range */
+			if (!args->lun_set && !args->blk_set) {
+				key_hi = ARCHIVE_KEY(ch, lun_hi, blk_hi);
+				lun = lun_hi;
+			}
+
+			n = archive_lookup(ar, run, key_lo, key_hi, recs, max);
+			if (n < 0)
+				return n;
+			for (int i = 0; i < n; i++)
+				hist_add(h, &recs[i]);
+		}
+	}
+
+	return 0;
+}
+
+static void hist_print(const char *prefix, const struct hist_sum *h)
+{
+	printf("%s blks %05u skip %05u bad %05u fail r %05u w %05u e %05u rpages %06lu lat r %8.1f w %8.1f e %8.1f us\n",
+			prefix, h->nblks, h->skipped, h->bad, h->fails[0], h->fails[1], h->fails[2],
+			(unsigned long)h->read_fails, hist_lat(h, 0), hist_lat(h, 1), hist_lat(h, 2));
+}
+
+/* least squares slope of y over run order, per 100 runs */
+static double hist_slope(const double *y, int n)
+{
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+	if (n < 2)
+		return 0.0;
+
+	for (int i = 0; i < n; i++) {
+		sx += i;
+		sy += y[i];
+		sxx += (double)i * i;
+		sxy += i * y[i];
+	}
+
+	return 100.0 * (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+static int dev_history(struct arguments *args)
+{
+	char devid[ARCHIVE_DEVID_LEN];
+	const char *source;
+	char sel[3][8];
+	struct archive *ar;
+	struct archive_rec *recs;
+	struct hist_sum h, first_h;
+	double *trend[4];
+	uint32_t first, last;
+	int n = 0, ret = 0;
+
+	if (!args->archive_id && !args->devname) {
+		ret = archive_list(args->archive, stdout);
+		if (ret)
+			printf("Could not list %s: %s\n", args->archive, strerror(-ret));
+		return ret;
+	}
+
+	if (args->archive_id) {
+		snprintf(devid, sizeof(devid), "%s", args->archive_id);
+	} else {
+		struct nvm_dev *dev = nvm_dev_open(args->devname);
+		const struct nvm_geo *geo;
+
+		if (!dev) {
+			printf("Could not open device.\n");
+			return -EINVAL;
+		}
+		geo = nvm_dev_get_geo(dev);
+		source = archive_devid(devid, args->devname, geo->nchannels, geo->nluns, geo->nblocks, geo->npages,
+				       geo->nsectors, geo->sector_nbytes);
+		nvm_dev_close(dev);
+		printf("Device id %s (from %s)\n", devid, source);
+	}
+
+	ar = archive_open(args->archive, devid);
+	if (!ar) {
+		printf("No archive for %s in %s\n", devid, args->archive);
+		return -ENOENT;
+	}
+
+	archive_range(ar, args->since, args->until_set ? args->until : UINT64_MAX, &first, &last);
+
+	recs = malloc(ar->hdr.nluns * ar->hdr.nblocks * sizeof(*recs));
+	for (int i = 0; i < 4; i++)
+		trend[i] = malloc((last - first + 1) * sizeof(double));
+	if (!recs || !trend[0] || !trend[1] || !trend[2] || !trend[3]) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	snprintf(sel[0], sizeof(sel[0]), args->ch_set ? "%02d" : "*", args->ch);
+	snprintf(sel[1], sizeof(sel[1]), args->lun_set ? "%02d" : "*", args->lun);
+	snprintf(sel[2], sizeof(sel[2]), args->blk_set ? "%03d" : "*", args->blk);
+	printf("History of %s (%s,%s,%s), runs %u of %u\n", devid, sel[0], sel[1], sel[2], last - first, ar->nruns);
+
+	for (uint32_t run = first; run < last; run++) {
+		char prefix[64];
+
+		ret = hist_run(ar, run, args, recs, &h);
+		if (ret) {
+			printf("Could not read run %u: %s\n", ar->runs[run].run, strerror(-ret));
+			goto out;
+		}
+		if (!h.nblks)
+			continue;
+
+		snprintf(prefix, sizeof(prefix), "[RUN %05u] %10lu", ar->runs[run].run, (unsigned long)ar->runs[run].time);
+		hist_print(prefix, &h);
+
+		if (!n)
+			first_h = h;
+		trend[0][n] = h.read_fails;
+		for (int op = 0; op < 3; op++)
+			trend[op + 1][n] = hist_lat(&h, op);
+		n++;
+	}
+
+	if (!n) {
+		printf("No results in range\n");
+		goto out;
+	}
+
+	printf("\nTrend over %d runs:\n", n);
+	hist_print("first", &first_h);
+	hist_print("last ", &h);
+	printf("slope per 100 runs: rpages %+.1f lat r %+.1f w %+.1f e %+.1f us\n",
+			hist_slope(trend[0], n), hist_slope(trend[1], n), hist_slope(trend[2], n), hist_slope(trend[3], n));
+out:
+	for (int i = 0; i < 4; i++)
+		free(trend[i]);
+	free(recs);
+	archive_close(ar);
+	return ret;
+}
+
+static struct argp_option opt_dev_history[] =
+{
+	{"archive", 'a', "DIR", 0, "Archive directory, lists the devices in it if no id or device is given"},
+	{"id", 'I', "ID", 0, "Archive id of the device"},
+	{"device", 'd', "DEVICE", 0, "Derive the archive id from DEVICE, e.g. /dev/nvme0n1"},
+	{"ch", 'c', "ch", 0, "Channel, all if not given"},
+	{"lun", 'l', "lun", 0, "LUN, all if not given"},
+	{"blk", 'b', "blk", 0, "Block, all if not given"},
+	{"since", 'S', "secs", 0, "Only runs at or after unix time secs"},
+	{"until", 'U', "secs", 0, "Only runs at or before unix time secs"},
+	{0}
+};
+
+static char doc_dev_history[] =
+		"\n\vExamples:\n"
+		" List the devices in an archive.\n"
+		"  lnvm history -a /var/lib/lnvm\n"
+		" Show how a block did over all archived runs of a device.\n"
+		"  lnvm history -a /var/lib/lnvm -d /dev/nvme0n1 -c 0 -l 3 -b 120\n"
+		" Show a LUN's totals per run.\n"
+		"  lnvm history -a /var/lib/lnvm -d /dev/nvme0n1 -c 0 -l 3\n";
+
+static error_t parse_dev_history_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *args = state->input;
+
+	switch (key) {
+	case 'a':
+		if (!arg || args->archive)
+			argp_usage(state);
+		args->archive = arg;
+		break;
+	case 'I':
+		if (!arg || args->archive_id || strlen(arg) >= ARCHIVE_DEVID_LEN)
+			argp_usage(state);
+		args->archive_id = arg;
+		break;
+	case 'd':
+		if (!arg || args->devname)
+			argp_usage(state);
+		if (strlen(arg) > DISK_NAME_LEN) {
+			printf("Argument too long\n");
+			argp_usage(state);
+		}
+		args->devname = arg;
+		break;
+	case 'c':
+		if (!arg || args->ch_set)
+			argp_usage(state);
+		args->ch_set = 1;
+		args->ch = atoi(arg);
+		break;
+	case 'l':
+		if (!arg || args->lun_set)
+			argp_usage(state);
+		args->lun_set = 1;
+		args->lun = atoi(arg);
+		break;
+	case 'b':
+		if (!arg || args->blk_set)
+			argp_usage(state);
+		args->blk_set = 1;
+		args->blk = atoi(arg);
+		break;
+	case 'S':
+		if (!arg || args->since)
+			argp_usage(state);
+		args->since = strtoul(arg, NULL, 0);
+		break;
+	case 'U':
+		if (!arg || args->until_set)
+			argp_usage(state);
+		args->until_set = 1;
+		args->until = strtoul(arg, NULL, 0);
+		break;
+	case ARGP_KEY_ARG:
+		argp_usage(state);
+		break;
+	case ARGP_KEY_END:
+		if (!args->archive)
+			argp_usage(state);
+		if (args->ch < 0 || args->ch > 0xff || args->lun < 0 || args->lun > 0xff ||
+		    args->blk < 0 || args->blk > 0xffff)
+			argp_usage(state);
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp argp_dev_history = {opt_dev_history, parse_dev_history_opt,
+							0, doc_dev_history};
+
+static void cmd_dev_history(struct argp_state *state, struct arguments *args)
+{
+	int argc = state->argc - state->next + 1;
+	char** argv = &state->argv[state->next - 1];
+	char* argv0 = argv[0];
+
+	argv[0] = malloc(strlen(state->name) + strlen(" history") + 1);
+	if(!argv[0])
+		argp_failure(state, 1, ENOMEM, 0);
+
+	sprintf(argv[0], "%s history", state->name);
+
+	argp_parse(&argp_dev_history, argc, argv, ARGP_IN_ORDER, &argc, args);
+
+	free(argv[0]);
+	argv[0] = argv0;
+	state->next += argc - 1;
+}
+
 const char *argp_program_version = "1.0";
 const char *argp_program_bug_address = "Matias Bjørling <matias@cnexlabs.com>";
+#ifndef LNVM_BENCH /* lnvm-bench brings its own main() */
 static char args_doc_global[] =
 		"\nSupported commands are:\n"
-		"  verify       Verify media\n";
+		"  verify       Verify media\n"
+		"  history      Show archived verify results over time\n";
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
 {
@@ -685,6 +3340,10 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 			args->cmdtype = LIGHTNVM_DEV_PLANE;
 			cmd_dev_plane(state, args);
 		}
+		if (strcmp(arg, "history") == 0) {
+			args->cmdtype = LIGHTNVM_DEV_HISTORY;
+			cmd_dev_history(state, args);
+		}
 		break;
 	default:
 		return ARGP_ERR_UNKNOWN;
@@ -710,9 +3369,13 @@ int main(int argc, char **argv)
 	case LIGHTNVM_DEV_PLANE:
 		dev_plane(&args);
 		break;
+	case LIGHTNVM_DEV_HISTORY:
+		dev_history(&args);
+		break;
 	default:
 		printf("No valid command given.\n");
 	}
 
 	return ret;
 }
+#endif
@@ -18,6 +18,7 @@
 enum cmdtypes {
 	LIGHTNVM_DEV_VERIFY = 1,
 	LIGHTNVM_DEV_PLANE = 2,
+	LIGHTNVM_DEV_HISTORY = 3,
 
 };
 
@@ -49,6 +50,48 @@ struct arguments
 	int skip_blk;
 
 	int plane_hint;
+	int no_oob;
+	int oob_fail;
+
+	int retries;
+	int retries_set;
+	int backoff_us;
+	int backoff_set;
+
+	char *failmap;
+
+	int line_mode;
+
+	char *progress;
+	int interval;
+
+	int hugepages;		/* enum bufpool_backing */
+
+	int profile;
+
+	double lun_fail_pct;	/* 0: keep testing failing LUNs */
+	int downgrade;		/* 0: stop a failed LUN, else test every Nth block */
+	double dev_fail_pct;	/* 0: never stop the run early */
+
+	int mixed;
+	int mix[3];		/* read, program, erase ratio */
+	int placement;
+	int placement_set;
+	int duration;
+
+	char *archive;
+	char *archive_id;
+
+	/* history */
+	int ch;
+	int ch_set;
+	int lun;
+	int lun_set;
+	int blk;
+	int blk_set;
+	unsigned long since;
+	unsigned long until;
+	int until_set;
 };
 
 
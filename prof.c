@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "prof.h"
+
+static const char *phase_name[] = { "address build", "pattern gen", "submit", "wait", "verify compare", "bookkeeping" };
+static const char *mode_name[] = { "clock only", "task clock only", "cycles, instructions (user only)",
+				   "cycles, instructions" };
+
+struct prof_sample {
+	uint64_t wall_ns;
+	uint64_t cpu_ns;
+	uint64_t cycles;
+	uint64_t instrs;
+};
+
+/* per thread: its perf group and the sample at its last lap */
+static __thread struct {
+	unsigned int gen;
+	int fd;
+	int mode;
+	struct prof_sample last;
+} pt;
+
+/* every fd opened, so that destroy can close them from one thread */
+static pthread_mutex_t fds_lock = PTHREAD_MUTEX_INITIALIZER;
+static int *fds;
+static int nfds;
+static unsigned int prof_gen;
+
+const char *prof_phase_name(int phase)
+{
+	return phase_name[phase];
+}
+
+const char *prof_mode_name(int mode)
+{
+	return mode_name[mode];
+}
+
+static int perf_open(uint32_t type, uint64_t config, int group, int exclude_kernel)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_kernel = exclude_kernel;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void fds_add(int fd)
+{
+	int *p;
+
+	pthread_mutex_lock(&fds_lock);
+	p = realloc(fds, (nfds + 1) * sizeof(*fds));
+	if (p) {
+		fds = p;
+		fds[nfds++] = fd;
+	}
+	pthread_mutex_unlock(&fds_lock);
+}
+
+static void prof_thread_open(struct prof *prof)
+{
+	int fd, fd_cyc, fd_ins;
+
+	pt.gen = prof->gen;
+	pt.mode = PROF_CLOCK;
+
+	fd = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1, 0);
+	if (fd < 0)
+		fd = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1, 1);
+	pt.fd = fd;
+	if (fd >= 0) {
+		pt.mode = PROF_TASK_CLOCK;
+		fds_add(fd);
+
+		for (int exclude_kernel = 0; exclude_kernel < 2; exclude_kernel++) {
+			fd_cyc = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, fd, exclude_kernel);
+			if (fd_cyc < 0)
+				continue;
+			fd_ins = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, fd, exclude_kernel);
+			if (fd_ins < 0) {
+				close(fd_cyc);
+				continue;
+			}
+			fds_add(fd_cyc);
+			fds_add(fd_ins);
+			pt.mode = exclude_kernel ? PROF_HW_USER : PROF_HW;
+			break;
+		}
+	}
+
+	/* the run reports the weakest mode any thread got */
+	for (int m = __atomic_load_n(&prof->mode, __ATOMIC_RELAXED); pt.mode < m;)
+		if (__atomic_compare_exchange_n(&prof->mode, &m, pt.mode, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+}
+
+static void prof_sample(struct prof *prof, struct prof_sample *s)
+{
+	struct {
+		uint64_t nr;
+		uint64_t v[3];
+	} rd;
+	struct timespec ts;
+
+	if (pt.gen != prof->gen)
+		prof_thread_open(prof);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->wall_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	s->cycles = s->instrs = 0;
+
+	if (pt.fd >= 0 && read(pt.fd, &rd, sizeof(rd)) > 0 && rd.nr) {
+		s->cpu_ns = rd.v[0];
+		if (rd.nr == 3) {
+			s->cycles = rd.v[1];
+			s->instrs = rd.v[2];
+		}
+		return;
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	s->cpu_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stat_add(struct prof_stat *st, uint64_t wall, uint64_t cpu, uint64_t cycles, uint64_t instrs)
+{
+	__atomic_fetch_add(&st->wall_ns, wall, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&st->cpu_ns, cpu, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&st->cycles, cycles, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&st->instrs, instrs, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&st->n, 1, __ATOMIC_RELAXED);
+}
+
+void prof_start_slow(struct prof *prof)
+{
+	prof_sample(prof, &pt.last);
+}
+
+void prof_lap_slow(struct prof *prof, int slot, int phase)
+{
+	struct prof_sample now;
+
+	/* a lap before this thread ever started has nothing to charge */
+	if (pt.gen != prof->gen) {
+		prof_start_slow(prof);
+		return;
+	}
+
+	prof_sample(prof, &now);
+	stat_add(&prof->slots[slot].ph[phase], now.wall_ns - pt.last.wall_ns, now.cpu_ns - pt.last.cpu_ns,
+		 now.cycles - pt.last.cycles, now.instrs - pt.last.instrs);
+	pt.last = now;
+}
+
+void prof_lap_io_slow(struct prof *prof, int slot)
+{
+	struct prof_sample now;
+	uint64_t wall, cpu;
+
+	if (pt.gen != prof->gen) {
+		prof_start_slow(prof);
+		return;
+	}
+
+	prof_sample(prof, &now);
+	wall = now.wall_ns - pt.last.wall_ns;
+	cpu = now.cpu_ns - pt.last.cpu_ns;
+	if (cpu > wall)
+		cpu = wall;
+
+	stat_add(&prof->slots[slot].ph[PROF_SUBMIT], cpu, cpu, now.cycles - pt.last.cycles, now.instrs - pt.last.instrs);
+	stat_add(&prof->slots[slot].ph[PROF_WAIT], wall - cpu, 0, 0, 0);
+	pt.last = now;
+}
+
+struct prof *prof_create(int nslots)
+{
+	struct prof *prof;
+
+	prof = calloc(1, sizeof(*prof));
+	if (!prof)
+		return NULL;
+
+	if (posix_memalign((void **)&prof->slots, 64, nslots * sizeof(struct prof_slot))) {
+		free(prof);
+		return NULL;
+	}
+	prof->nslots = nslots;
+	prof->mode = PROF_HW;
+	prof->gen = __atomic_add_fetch(&prof_gen, 1, __ATOMIC_RELAXED);
+	prof_reset(prof);
+
+	return prof;
+}
+
+void prof_reset(struct prof *prof)
+{
+	if (prof)
+		memset(prof->slots, 0, prof->nslots * sizeof(struct prof_slot));
+}
+
+void prof_total(const struct prof *prof, struct prof_stat out[PROF_NPHASES])
+{
+	memset(out, 0, PROF_NPHASES * sizeof(*out));
+	if (!prof)
+		return;
+
+	for (int slot = 0; slot < prof->nslots; slot++) {
+		for (int ph = 0; ph < PROF_NPHASES; ph++) {
+			const struct prof_stat *st = &prof->slots[slot].ph[ph];
+
+			out[ph].wall_ns += __atomic_load_n(&st->wall_ns, __ATOMIC_RELAXED);
+			out[ph].cpu_ns += __atomic_load_n(&st->cpu_ns, __ATOMIC_RELAXED);
+			out[ph].cycles += __atomic_load_n(&st->cycles, __ATOMIC_RELAXED);
+			out[ph].instrs += __atomic_load_n(&st->instrs, __ATOMIC_RELAXED);
+			out[ph].n += __atomic_load_n(&st->n, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void prof_destroy(struct prof *prof)
+{
+	if (!prof)
+		return;
+
+	pthread_mutex_lock(&fds_lock);
+	for (int i = 0; i < nfds; i++)
+		close(fds[i]);
+	free(fds);
+	fds = NULL;
+	nfds = 0;
+	pthread_mutex_unlock(&fds_lock);
+
+	free(prof->slots);
+	free(prof);
+}
@@ -0,0 +1,86 @@
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+
+/*
+ * Opt-in per phase profiling. A thread calls prof_start() when it takes on
+ * work, then prof_lap() at each phase boundary, which charges everything
+ * since its previous lap to the phase given and to a slot, one per LUN.
+ *
+ * Each thread opens its own perf group, task clock with cycles and
+ * instructions, on first use. Without hardware counters only the task
+ * clock is read, and without perf at all CPU time comes from the thread
+ * CPU clock. A lap costs a clock read plus, with perf, a read() syscall,
+ * so expect a few microseconds per command while profiling.
+ */
+enum prof_phase {
+	PROF_ADDR,		/* building PPA lists */
+	PROF_PATTERN,		/* OOB signatures */
+	PROF_SUBMIT,		/* CPU time inside the I/O call */
+	PROF_WAIT,		/* rest of the I/O call, off CPU */
+	PROF_VERIFY,		/* OOB signature checks */
+	PROF_BOOK,		/* everything else */
+	PROF_NPHASES,
+};
+
+enum prof_mode {
+	PROF_CLOCK = 0,		/* no perf, thread CPU clock */
+	PROF_TASK_CLOCK = 1,	/* perf task clock, no hardware counters */
+	PROF_HW_USER = 2,	/* cycles and instructions in user space only */
+	PROF_HW = 3,		/* cycles and instructions, kernel included */
+};
+
+struct prof_stat {
+	uint64_t wall_ns;
+	uint64_t cpu_ns;
+	uint64_t cycles;
+	uint64_t instrs;
+	uint64_t n;
+};
+
+struct prof_slot {
+	struct prof_stat ph[PROF_NPHASES];
+} __attribute__((aligned(64)));
+
+struct prof {
+	int nslots;
+	struct prof_slot *slots;
+	int mode;		/* worst seen over all threads */
+	unsigned int gen;
+};
+
+struct prof *prof_create(int nslots);
+void prof_destroy(struct prof *prof);
+void prof_reset(struct prof *prof);
+
+/* phase totals over all slots */
+void prof_total(const struct prof *prof, struct prof_stat out[PROF_NPHASES]);
+
+void prof_start_slow(struct prof *prof);
+void prof_lap_slow(struct prof *prof, int slot, int phase);
+void prof_lap_io_slow(struct prof *prof, int slot);
+
+const char *prof_phase_name(int phase);
+const char *prof_mode_name(int mode);
+
+static inline void prof_start(struct prof *prof)
+{
+	if (prof)
+		prof_start_slow(prof);
+}
+
+static inline void prof_lap(struct prof *prof, int slot, int phase)
+{
+	if (prof)
+		prof_lap_slow(prof, slot, phase);
+}
+
+/* after a synchronous I/O call: CPU time to PROF_SUBMIT, the rest to PROF_WAIT */
+static inline void prof_lap_io(struct prof *prof, int slot)
+{
+	if (prof)
+		prof_lap_io_slow(prof, slot);
+}
+
+#endif
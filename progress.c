@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "progress.h"
+
+static const char *progress_op_name[] = { "read", "write", "erase", "line", "mixed" };
+
+static uint64_t realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t hist_pct(const uint64_t *hist, uint64_t n, int pct)
+{
+	uint64_t want = (n * pct + 99) / 100, seen = 0;
+
+	if (!n)
+		return 0;
+
+	for (int b = 0; b < PROGRESS_NBUCKETS; b++) {
+		seen += hist[b];
+		if (seen >= want)
+			return 2U << b;		/* bucket upper bound */
+	}
+
+	return 2U << (PROGRESS_NBUCKETS - 1);
+}
+
+static void progress_refresh(struct progress *prog, int print)
+{
+	struct progress_hdr *hdr = prog->hdr;
+	uint64_t all[PROGRESS_NBUCKETS] = { 0 };
+	uint64_t blks = 0, bytes = 0, errors = 0, ncmds = 0;
+	uint64_t now = realtime_ns();
+	uint64_t elapsed = now - __atomic_load_n(&hdr->pass_start_ns, __ATOMIC_RELAXED);
+
+	for (uint32_t i = 0; i < hdr->nworkers; i++) {
+		struct progress_worker *w = &prog->workers[i];
+		uint64_t hist[PROGRESS_NBUCKETS], n = 0;
+
+		for (int b = 0; b < PROGRESS_NBUCKETS; b++) {
+			hist[b] = __atomic_load_n(&w->lat_hist[b], __ATOMIC_RELAXED);
+			all[b] += hist[b];
+			n += hist[b];
+		}
+		w->lat_p50_us = hist_pct(hist, n, 50);
+		w->lat_p99_us = hist_pct(hist, n, 99);
+
+		blks += __atomic_load_n(&w->blks_done, __ATOMIC_RELAXED);
+		bytes += __atomic_load_n(&w->bytes, __ATOMIC_RELAXED);
+		errors += __atomic_load_n(&w->errors, __ATOMIC_RELAXED);
+		ncmds += n;
+	}
+
+	hdr->lat_p50_us = hist_pct(all, ncmds, 50);
+	hdr->lat_p99_us = hist_pct(all, ncmds, 99);
+	hdr->eta_ns = 0;
+	if (blks && blks < hdr->pass_blks)
+		hdr->eta_ns = (double)elapsed * (hdr->pass_blks - blks) / blks;
+	hdr->update_ns = now;
+	__atomic_fetch_add(&hdr->seq, 1, __ATOMIC_RELEASE);
+
+	if (!print || !hdr->pass)
+		return;
+
+	fprintf(stderr, "[progress] pass %u %-5s %5.1f%% blks %lu/%lu %8.1f MB/s errors %lu p50 %u us p99 %u us eta %02lu:%02lu:%02lu\n",
+		hdr->pass, progress_op_name[hdr->op],
+		hdr->pass_blks ? 100.0 * blks / hdr->pass_blks : 0.0,
+		(unsigned long)blks, (unsigned long)hdr->pass_blks,
+		elapsed ? bytes * 1000.0 / elapsed : 0.0, (unsigned long)errors,
+		hdr->lat_p50_us, hdr->lat_p99_us,
+		(unsigned long)(hdr->eta_ns / 3600000000000ULL),
+		(unsigned long)(hdr->eta_ns / 60000000000ULL % 60),
+		(unsigned long)(hdr->eta_ns / 1000000000ULL % 60));
+}
+
+static void *progress_thread(void *arg)
+{
+	struct progress *prog = arg;
+	int period_ms = prog->interval ? prog->interval * 1000 : 1000;
+	int slept = 0;
+
+	while (!__atomic_load_n(&prog->stop, __ATOMIC_ACQUIRE)) {
+		usleep(100 * 1000);
+		slept += 100;
+		if (slept < period_ms)
+			continue;
+		slept = 0;
+		progress_refresh(prog, prog->interval);
+	}
+
+	return NULL;
+}
+
+struct progress *progress_create(const char *path, int nchannels, int nluns, int interval)
+{
+	struct progress *prog;
+	void *map;
+	int fd = -1;
+
+	prog = calloc(1, sizeof(*prog));
+	if (!prog)
+		return NULL;
+
+	prog->interval = interval;
+	prog->nbytes = sizeof(struct progress_hdr) + nchannels * nluns * sizeof(struct progress_worker);
+
+	if (path) {
+		fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || ftruncate(fd, prog->nbytes)) {
+			perror("Could not create progress file");
+			goto err;
+		}
+		map = mmap(NULL, prog->nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	} else {
+		map = mmap(NULL, prog->nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (map == MAP_FAILED) {
+		perror("Could not map progress file");
+		goto err;
+	}
+	if (fd >= 0)
+		close(fd);
+
+	memset(map, 0, prog->nbytes);
+	prog->hdr = map;
+	prog->workers = (struct progress_worker *)(prog->hdr + 1);
+
+	prog->hdr->version = PROGRESS_VERSION;
+	prog->hdr->hdr_nbytes = sizeof(struct progress_hdr);
+	prog->hdr->worker_nbytes = sizeof(struct progress_worker);
+	prog->hdr->nworkers = nchannels * nluns;
+	prog->hdr->nchannels = nchannels;
+	prog->hdr->nluns = nluns;
+	prog->hdr->pid = getpid();
+	prog->hdr->start_ns = prog->hdr->pass_start_ns = realtime_ns();
+	/* published last, a monitor may be polling already */
+	__atomic_store_n(&prog->hdr->magic, PROGRESS_MAGIC, __ATOMIC_RELEASE);
+
+	if (path || interval) {
+		if (pthread_create(&prog->thread, NULL, progress_thread, prog)) {
+			perror("Could not start progress thread");
+			munmap(map, prog->nbytes);
+			goto err;
+		}
+		prog->running = 1;
+	}
+
+	return prog;
+err:
+	if (fd >= 0)
+		close(fd);
+	free(prog);
+	return NULL;
+}
+
+void progress_destroy(struct progress *prog)
+{
+	if (!prog)
+		return;
+
+	if (prog->running) {
+		__atomic_store_n(&prog->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(prog->thread, NULL);
+	}
+
+	prog->hdr->done = 1;
+	progress_refresh(prog, prog->interval);
+	munmap(prog->hdr, prog->nbytes);
+	free(prog);
+}
+
+void progress_pass_begin(struct progress *prog, int op, uint64_t pass_blks)
+{
+	struct progress_hdr *hdr;
+
+	if (!prog)
+		return;
+
+	hdr = prog->hdr;
+	for (uint32_t i = 0; i < hdr->nworkers; i++) {
+		struct progress_worker *w = &prog->workers[i];
+
+		__atomic_store_n(&w->blks_done, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&w->cmds, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&w->bytes, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&w->errors, 0, __ATOMIC_RELAXED);
+		for (int b = 0; b < PROGRESS_NBUCKETS; b++)
+			__atomic_store_n(&w->lat_hist[b], 0, __ATOMIC_RELAXED);
+	}
+
+	hdr->op = op;
+	hdr->pass_blks = pass_blks;
+	__atomic_store_n(&hdr->pass_start_ns, realtime_ns(), __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hdr->pass, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,128 @@
+#ifndef PROGRESS_H_
+#define PROGRESS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Live run progress, laid out for external monitors. The region is a header
+ * followed by nworkers worker slots, one per LUN (ch * nluns + lun). When a
+ * path is given it is a MAP_SHARED file, so a path under /dev/shm is a
+ * shared memory segment.
+ *
+ * Workers only do relaxed atomic adds on their own slot. The updater thread
+ * derives the percentile fields and bumps seq after each refresh. Readers
+ * must check magic, version and the two size fields before parsing, and
+ * should treat values as a snapshot that may be slightly torn.
+ */
+#define PROGRESS_MAGIC		0x474f52504d564e4cULL	/* "LNVMPROG" */
+#define PROGRESS_VERSION	1
+#define PROGRESS_NBUCKETS	32	/* bucket i: [2^i, 2^(i+1)) usecs */
+
+enum progress_op {
+	PROGRESS_OP_READ = 0,
+	PROGRESS_OP_WRITE = 1,
+	PROGRESS_OP_ERASE = 2,
+	PROGRESS_OP_LINE = 3,
+	PROGRESS_OP_MIXED = 4,
+};
+
+struct progress_worker {
+	uint64_t blks_done;		/* this pass */
+	uint64_t cmds;			/* this pass */
+	uint64_t bytes;			/* this pass */
+	uint64_t errors;		/* this pass */
+	uint64_t cmds_total;		/* whole run */
+	uint64_t bytes_total;
+	uint64_t errors_total;
+	uint32_t lat_p50_us;		/* this pass, set by the updater */
+	uint32_t lat_p99_us;
+	uint32_t lat_hist[PROGRESS_NBUCKETS];
+} __attribute__((aligned(64)));
+
+struct progress_hdr {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t hdr_nbytes;
+	uint32_t worker_nbytes;
+	uint32_t nworkers;
+	uint32_t nchannels;
+	uint32_t nluns;
+
+	uint64_t seq;			/* bumped after every refresh */
+	uint32_t pid;
+	uint32_t done;			/* run finished */
+
+	uint32_t pass;			/* 1 based, 0 before the first */
+	uint32_t op;			/* enum progress_op */
+	uint64_t pass_blks;		/* blocks to visit this pass */
+	uint64_t start_ns;		/* CLOCK_REALTIME */
+	uint64_t pass_start_ns;
+	uint64_t update_ns;
+
+	uint32_t lat_p50_us;		/* all workers, this pass */
+	uint32_t lat_p99_us;
+	uint64_t eta_ns;		/* 0 if unknown */
+} __attribute__((aligned(64)));
+
+struct progress {
+	struct progress_hdr *hdr;
+	struct progress_worker *workers;
+	size_t nbytes;
+	int interval;			/* print every interval secs, 0 off */
+
+	pthread_t thread;
+	int running;
+	int stop;
+};
+
+struct progress *progress_create(const char *path, int nchannels, int nluns, int interval);
+void progress_destroy(struct progress *prog);
+
+/* main thread only, while no worker is running */
+void progress_pass_begin(struct progress *prog, int op, uint64_t pass_blks);
+
+static inline void progress_cmd(struct progress *prog, int idx, uint64_t bytes, int failed, uint64_t lat_ns)
+{
+	struct progress_worker *w;
+	uint64_t us = lat_ns / 1000;
+	int b = 0;
+
+	if (!prog)
+		return;
+
+	w = &prog->workers[idx];
+	while (us > 1 && b < PROGRESS_NBUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+
+	__atomic_fetch_add(&w->cmds, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&w->cmds_total, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&w->lat_hist[b], 1, __ATOMIC_RELAXED);
+	if (bytes) {
+		__atomic_fetch_add(&w->bytes, bytes, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&w->bytes_total, bytes, __ATOMIC_RELAXED);
+	}
+	if (failed) {
+		__atomic_fetch_add(&w->errors, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&w->errors_total, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static inline void progress_blk(struct progress *prog, int idx)
+{
+	if (prog)
+		__atomic_fetch_add(&prog->workers[idx].blks_done, 1, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t progress_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
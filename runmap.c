@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "runmap.h"
+
+#define RUN_START(m, i) ((m)->runs[2 * (i)])
+#define RUN_END(m, i) ((m)->runs[2 * (i) + 1])
+
+static int runmap_reserve(struct runmap *m, uint32_t nruns)
+{
+	uint32_t cap = m->cap ? m->cap : 2;
+	uint32_t *runs;
+
+	if (nruns <= m->cap)
+		return 0;
+
+	while (cap < nruns)
+		cap *= 2;
+
+	runs = realloc(m->runs, cap * 2 * sizeof(uint32_t));
+	if (!runs)
+		return -ENOMEM;
+
+	m->runs = runs;
+	m->cap = cap;
+	return 0;
+}
+
+/* append [start, end) with start at or past the last run's start */
+static int runmap_append(struct runmap *m, uint32_t start, uint32_t end)
+{
+	if (m->nruns && start <= RUN_END(m, m->nruns - 1)) {
+		if (end > RUN_END(m, m->nruns - 1))
+			RUN_END(m, m->nruns - 1) = end;
+		return 0;
+	}
+
+	if (runmap_reserve(m, m->nruns + 1))
+		return -ENOMEM;
+
+	RUN_START(m, m->nruns) = start;
+	RUN_END(m, m->nruns) = end;
+	m->nruns++;
+	return 0;
+}
+
+int runmap_add_range(struct runmap *m, uint32_t start, uint32_t len)
+{
+	struct runmap one = { (uint32_t[]){ start, start + len }, 1, 1 };
+	struct runmap tmp = RUNMAP_INIT;
+
+	if (!len)
+		return 0;
+
+	if (!m->nruns || start >= RUN_START(m, m->nruns - 1))
+		return runmap_append(m, start, start + len);
+
+	/* out of order, rare: merge into a fresh map */
+	if (runmap_union(&tmp, m, &one))
+		return -ENOMEM;
+
+	runmap_free(m);
+	*m = tmp;
+	return 0;
+}
+
+int runmap_add(struct runmap *m, uint32_t bit)
+{
+	return runmap_add_range(m, bit, 1);
+}
+
+int runmap_test(const struct runmap *m, uint32_t bit)
+{
+	uint32_t lo = 0, hi = m->nruns;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (bit < RUN_START(m, mid))
+			hi = mid;
+		else if (bit >= RUN_END(m, mid))
+			lo = mid + 1;
+		else
+			return 1;
+	}
+
+	return 0;
+}
+
+uint64_t runmap_count(const struct runmap *m)
+{
+	uint64_t n = 0;
+
+	for (uint32_t i = 0; i < m->nruns; i++)
+		n += RUN_END(m, i) - RUN_START(m, i);
+
+	return n;
+}
+
+int runmap_union(struct runmap *dst, const struct runmap *a, const struct runmap *b)
+{
+	uint32_t i = 0, j = 0;
+
+	runmap_clear(dst);
+	if (runmap_reserve(dst, a->nruns + b->nruns))
+		return -ENOMEM;
+
+	while (i < a->nruns || j < b->nruns) {
+		const struct runmap *m;
+		uint32_t k;
+
+		if (j == b->nruns || (i < a->nruns && RUN_START(a, i) <= RUN_START(b, j))) {
+			m = a;
+			k = i++;
+		} else {
+			m = b;
+			k = j++;
+		}
+		runmap_append(dst, RUN_START(m, k), RUN_END(m, k));
+	}
+
+	return 0;
+}
+
+int runmap_intersect(struct runmap *dst, const struct runmap *a, const struct runmap *b)
+{
+	uint32_t i = 0, j = 0;
+
+	runmap_clear(dst);
+
+	while (i < a->nruns && j < b->nruns) {
+		uint32_t start = RUN_START(a, i) > RUN_START(b, j) ? RUN_START(a, i) : RUN_START(b, j);
+		uint32_t end = RUN_END(a, i) < RUN_END(b, j) ? RUN_END(a, i) : RUN_END(b, j);
+
+		if (start < end && runmap_append(dst, start, end))
+			return -ENOMEM;
+
+		if (RUN_END(a, i) < RUN_END(b, j))
+			i++;
+		else
+			j++;
+	}
+
+	return 0;
+}
+
+int runmap_copy(struct runmap *dst, const struct runmap *src)
+{
+	runmap_clear(dst);
+	if (runmap_reserve(dst, src->nruns))
+		return -ENOMEM;
+
+	if (src->nruns)
+		memcpy(dst->runs, src->runs, src->nruns * 2 * sizeof(uint32_t));
+	dst->nruns = src->nruns;
+	return 0;
+}
+
+void runmap_clear(struct runmap *m)
+{
+	m->nruns = 0;
+}
+
+void runmap_free(struct runmap *m)
+{
+	free(m->runs);
+	m->runs = NULL;
+	m->nruns = m->cap = 0;
+}
+
+size_t runmap_nbytes(const struct runmap *m)
+{
+	return m->cap * 2 * sizeof(uint32_t);
+}
+
+void runmap_fprint(FILE *fp, const struct runmap *m)
+{
+	for (uint32_t i = 0; i < m->nruns; i++) {
+		if (i)
+			fputc(',', fp);
+		if (RUN_END(m, i) - RUN_START(m, i) == 1)
+			fprintf(fp, "%u", RUN_START(m, i));
+		else
+			fprintf(fp, "%u-%u", RUN_START(m, i), RUN_END(m, i) - 1);
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef RUNMAP_H_
+#define RUNMAP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Run-length encoded bitmap. Set bits are kept as sorted, disjoint,
+ * non-adjacent [start, end) runs, so an empty map costs nothing and a map
+ * grows with the number of runs rather than the number of bits. Adding bits
+ * in ascending order, as the I/O path does, is O(1).
+ */
+struct runmap {
+	uint32_t *runs;		/* nruns pairs of start, end */
+	uint32_t nruns;
+	uint32_t cap;
+};
+
+#define RUNMAP_INIT { NULL, 0, 0 }
+
+int runmap_add_range(struct runmap *m, uint32_t start, uint32_t len);
+int runmap_add(struct runmap *m, uint32_t bit);
+int runmap_test(const struct runmap *m, uint32_t bit);
+uint64_t runmap_count(const struct runmap *m);
+
+/* dst may alias neither a nor b */
+int runmap_union(struct runmap *dst, const struct runmap *a, const struct runmap *b);
+int runmap_intersect(struct runmap *dst, const struct runmap *a, const struct runmap *b);
+
+int runmap_copy(struct runmap *dst, const struct runmap *src);
+void runmap_clear(struct runmap *m);
+void runmap_free(struct runmap *m);
+size_t runmap_nbytes(const struct runmap *m);
+
+/* "0-15,64,70-71" */
+void runmap_fprint(FILE *fp, const struct runmap *m);
+
+#endif